@@ -1,8 +1,12 @@
 #include "accelerator.h"
 
+#include "cpu/image/image_mixer.h"
 #include "ogl/image/image_mixer.h"
 #include "ogl/util/device.h"
 
+#include <common/env.h>
+
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 #include <core/mixer/image/image_mixer.h>
@@ -17,15 +21,25 @@ struct accelerator::impl
 {
     std::shared_ptr<ogl::device> ogl_device_;
 
+    const bool cpu_ = boost::iequals(env::properties().get(L"configuration.accelerator", L"gpu"), L"cpu");
+
     impl() {}
 
     std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id)
     {
+        if (cpu_) {
+            return std::make_unique<cpu::image_mixer>(channel_id);
+        }
+
         return std::make_unique<ogl::image_mixer>(spl::make_shared_ptr(get_device()), channel_id);
     }
 
     std::shared_ptr<ogl::device> get_device()
     {
+        if (cpu_) {
+            return nullptr;
+        }
+
         if (!ogl_device_) {
             ogl_device_ = std::make_shared<ogl::device>();
         }
@@ -0,0 +1,664 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "image_mixer.h"
+
+#include <common/array.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/cache_aligned_allocator.h>
+#include <tbb/parallel_for.h>
+
+#include <smmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+using buffer_t = std::vector<std::uint8_t, tbb::cache_aligned_allocator<std::uint8_t>>;
+
+enum class keyer
+{
+    linear = 0,
+    additive,
+};
+
+struct item
+{
+    core::pixel_format_desc           pix_desc = core::pixel_format::invalid;
+    std::vector<array<const uint8_t>> data;
+    core::image_transform             transform;
+};
+
+struct layer
+{
+    std::vector<layer> sublayers;
+    std::vector<item>  items;
+    core::blend_mode   blend_mode;
+
+    explicit layer(core::blend_mode blend_mode)
+        : blend_mode(blend_mode)
+    {
+    }
+};
+
+// Rounded x / 255 for 16 bit lanes holding products of two bytes.
+inline __m128i div255_epu16(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+inline std::uint8_t div255(int x)
+{
+    x += 128;
+    return static_cast<std::uint8_t>((x + (x >> 8)) >> 8);
+}
+
+// Multiplies every channel of premultiplied bgra pixels by a per pixel coverage.
+void scale_row(std::uint8_t* dst, const std::uint8_t* coverage, int count)
+{
+    const auto zero = _mm_setzero_si128();
+    const auto mask = _mm_set_epi8(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    auto       n    = 0;
+    for (; n + 4 <= count; n += 4) {
+        int c;
+        std::memcpy(&c, coverage + n, 4);
+        if (c == -1) {
+            continue;
+        }
+
+        auto s  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + n * 4));
+        auto k  = _mm_shuffle_epi8(_mm_cvtsi32_si128(c), mask);
+        auto lo = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(k, zero)));
+        auto hi = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(k, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n * 4), _mm_packus_epi16(lo, hi));
+    }
+    for (; n < count; ++n) {
+        for (int c = 0; c < 4; ++c) {
+            dst[n * 4 + c] = div255(dst[n * 4 + c] * coverage[n]);
+        }
+    }
+}
+
+// Composites premultiplied bgra pixels onto a premultiplied bgra background.
+void blend_row(std::uint8_t* dst, const std::uint8_t* src, int count, keyer keyer)
+{
+    auto n = 0;
+    if (keyer == keyer::additive) {
+        for (; n + 4 <= count; n += 4) {
+            auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * 4));
+            auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + n * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n * 4), _mm_adds_epu8(s, d));
+        }
+        for (; n < count * 4; ++n) {
+            dst[n] = static_cast<std::uint8_t>(std::min(255, dst[n] + src[n]));
+        }
+        return;
+    }
+
+    const auto zero = _mm_setzero_si128();
+    const auto ones = _mm_set1_epi8(-1);
+    const auto mask = _mm_set_epi8(15, 15, 15, 15, 11, 11, 11, 11, 7, 7, 7, 7, 3, 3, 3, 3);
+    for (; n + 4 <= count; n += 4) {
+        auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * 4));
+        auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + n * 4));
+
+        // 255 - a == ~a for bytes.
+        auto inv = _mm_xor_si128(_mm_shuffle_epi8(s, mask), ones);
+        auto lo  = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(inv, zero)));
+        auto hi  = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(inv, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n * 4), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+    }
+    for (; n < count; ++n) {
+        auto inv = 255 - src[n * 4 + 3];
+        for (int c = 0; c < 4; ++c) {
+            dst[n * 4 + c] = static_cast<std::uint8_t>(std::min(255, src[n * 4 + c] + div255(dst[n * 4 + c] * inv)));
+        }
+    }
+}
+
+// Composites the blue channel of premultiplied bgra pixels onto a single channel key.
+void blend_key_row(std::uint8_t* dst, const std::uint8_t* src, int count)
+{
+    for (int n = 0; n < count; ++n) {
+        dst[n] = static_cast<std::uint8_t>(std::min(255, src[n * 4] + div255(dst[n] * (255 - src[n * 4 + 3]))));
+    }
+}
+
+inline std::uint8_t clamp_byte(int value) { return static_cast<std::uint8_t>(std::max(0, std::min(255, value))); }
+
+// Fixed point (10 bit) ycbcr to bgr coefficients, see ycbcra_to_rgba in the ogl fragment shader.
+struct ycbcr_coefficients
+{
+    int y;
+    int cr_r;
+    int cr_g;
+    int cb_g;
+    int cb_b;
+};
+
+const ycbcr_coefficients ycbcr_sd = {1192, 1634, 833, 400, 2066};
+const ycbcr_coefficients ycbcr_hd = {1192, 1836, 547, 218, 2166};
+
+inline void ycbcra_to_bgra(std::uint8_t* dst, int y, int cb, int cr, int a, const ycbcr_coefficients& k)
+{
+    y  = (y - 16) * k.y;
+    cb = cb - 128;
+    cr = cr - 128;
+
+    dst[0] = clamp_byte((y + k.cb_b * cb + 512) >> 10);
+    dst[1] = clamp_byte((y - k.cr_g * cr - k.cb_g * cb + 512) >> 10);
+    dst[2] = clamp_byte((y + k.cr_r * cr + 512) >> 10);
+    dst[3] = static_cast<std::uint8_t>(a);
+
+    // The alpha plane is straight, while blend_row expects premultiplied pixels.
+    if (a < 255) {
+        dst[0] = div255(dst[0] * a);
+        dst[1] = div255(dst[1] * a);
+        dst[2] = div255(dst[2] * a);
+    }
+}
+
+// Samples one destination row of an item into premultiplied bgra, nearest neighbour.
+void sample_row(std::uint8_t*                           dst,
+                const item&                             item,
+                const std::vector<const std::uint8_t*>& rows,
+                const std::vector<std::vector<int>>&    columns,
+                int                                     count)
+{
+    const auto& planes = item.pix_desc.planes;
+
+    switch (item.pix_desc.format) {
+        case core::pixel_format::bgra:
+        case core::pixel_format::rgba:
+        case core::pixel_format::argb:
+        case core::pixel_format::abgr: {
+            static const int swizzle[][4] = {{0, 1, 2, 3}, {2, 1, 0, 3}, {3, 2, 1, 0}, {1, 2, 3, 0}};
+            const auto&      order =
+                swizzle[static_cast<int>(item.pix_desc.format) - static_cast<int>(core::pixel_format::bgra)];
+            const auto& xs = columns[0];
+            for (int n = 0; n < count; ++n) {
+                auto src       = rows[0] + xs[n] * 4;
+                dst[n * 4 + 0] = src[order[0]];
+                dst[n * 4 + 1] = src[order[1]];
+                dst[n * 4 + 2] = src[order[2]];
+                dst[n * 4 + 3] = src[order[3]];
+            }
+            break;
+        }
+        case core::pixel_format::bgr:
+        case core::pixel_format::rgb: {
+            const auto  b  = item.pix_desc.format == core::pixel_format::bgr ? 0 : 2;
+            const auto& xs = columns[0];
+            for (int n = 0; n < count; ++n) {
+                auto src       = rows[0] + xs[n] * 3;
+                dst[n * 4 + 0] = src[b];
+                dst[n * 4 + 1] = src[1];
+                dst[n * 4 + 2] = src[2 - b];
+                dst[n * 4 + 3] = 255;
+            }
+            break;
+        }
+        case core::pixel_format::gray:
+        case core::pixel_format::luma: {
+            const auto  luma = item.pix_desc.format == core::pixel_format::luma;
+            const auto& xs   = columns[0];
+            for (int n = 0; n < count; ++n) {
+                auto value     = rows[0][xs[n]];
+                auto v         = luma ? clamp_byte(((value - 16) * 255 + 109) / 219) : value;
+                dst[n * 4 + 0] = v;
+                dst[n * 4 + 1] = v;
+                dst[n * 4 + 2] = v;
+                dst[n * 4 + 3] = 255;
+            }
+            break;
+        }
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::ycbcra: {
+            const auto& k     = planes.at(0).height > 700 ? ycbcr_hd : ycbcr_sd;
+            const auto  alpha = item.pix_desc.format == core::pixel_format::ycbcra;
+            for (int n = 0; n < count; ++n) {
+                ycbcra_to_bgra(dst + n * 4,
+                               rows[0][columns[0][n]],
+                               rows[1][columns[1][n]],
+                               rows[2][columns[2][n]],
+                               alpha ? rows[3][columns[3][n]] : 255,
+                               k);
+            }
+            break;
+        }
+        default:
+            std::memset(dst, 0, count * 4);
+            break;
+    }
+}
+
+float blend_channel(core::blend_mode mode, float back, float fore)
+{
+    switch (mode) {
+        case core::blend_mode::lighten:
+            return std::max(back, fore);
+        case core::blend_mode::darken:
+            return std::min(back, fore);
+        case core::blend_mode::multiply:
+            return back * fore;
+        case core::blend_mode::average:
+            return (back + fore) / 2.0f;
+        case core::blend_mode::add:
+        case core::blend_mode::linear_dodge:
+            return std::min(back + fore, 1.0f);
+        case core::blend_mode::subtract:
+        case core::blend_mode::linear_burn:
+            return std::max(back + fore - 1.0f, 0.0f);
+        case core::blend_mode::difference:
+            return std::abs(back - fore);
+        case core::blend_mode::negation:
+            return 1.0f - std::abs(1.0f - back - fore);
+        case core::blend_mode::exclusion:
+            return back + fore - 2.0f * back * fore;
+        case core::blend_mode::screen:
+            return 1.0f - (1.0f - back) * (1.0f - fore);
+        case core::blend_mode::overlay:
+            return back < 0.5f ? 2.0f * back * fore : 1.0f - 2.0f * (1.0f - back) * (1.0f - fore);
+        case core::blend_mode::hard_light:
+            return fore < 0.5f ? 2.0f * back * fore : 1.0f - 2.0f * (1.0f - back) * (1.0f - fore);
+        case core::blend_mode::phoenix:
+            return std::min(back, fore) - std::max(back, fore) + 1.0f;
+        default:
+            return fore;
+    }
+}
+
+class image_renderer
+{
+    int channel_id_;
+
+  public:
+    explicit image_renderer(int channel_id)
+        : channel_id_(channel_id)
+    {
+    }
+
+    array<const std::uint8_t> operator()(std::vector<layer> layers, const core::video_format_desc& format_desc)
+    {
+        auto target = std::make_shared<buffer_t>(format_desc.size, 0);
+
+        draw(*target, std::move(layers), format_desc);
+
+        return array<const std::uint8_t>(target->data(), format_desc.size, std::move(target));
+    }
+
+  private:
+    void draw(buffer_t& target, std::vector<layer> layers, const core::video_format_desc& format_desc)
+    {
+        std::shared_ptr<buffer_t> layer_key;
+
+        for (auto& layer : layers) {
+            draw(target, std::move(layer.sublayers), format_desc);
+            draw(target, std::move(layer), layer_key, format_desc);
+        }
+    }
+
+    void draw(buffer_t&                      target,
+              layer                          layer,
+              std::shared_ptr<buffer_t>&     layer_key,
+              const core::video_format_desc& format_desc)
+    {
+        if (layer.items.empty())
+            return;
+
+        std::shared_ptr<buffer_t> local_key;
+        std::shared_ptr<buffer_t> local_mix;
+
+        if (layer.blend_mode != core::blend_mode::normal) {
+            buffer_t layer_buffer(target.size(), 0);
+
+            for (auto& item : layer.items)
+                draw(layer_buffer, std::move(item), layer_key, local_key, local_mix, format_desc);
+
+            composite(layer_buffer, std::move(local_mix), core::blend_mode::normal, format_desc);
+            composite(target, std::make_shared<buffer_t>(std::move(layer_buffer)), layer.blend_mode, format_desc);
+        } else // fast path
+        {
+            for (auto& item : layer.items)
+                draw(target, std::move(item), layer_key, local_key, local_mix, format_desc);
+
+            composite(target, std::move(local_mix), core::blend_mode::normal, format_desc);
+        }
+
+        layer_key = std::move(local_key);
+    }
+
+    void draw(buffer_t&                      target,
+              item                           item,
+              std::shared_ptr<buffer_t>&     layer_key,
+              std::shared_ptr<buffer_t>&     local_key,
+              std::shared_ptr<buffer_t>&     local_mix,
+              const core::video_format_desc& format_desc)
+    {
+        if (item.transform.is_key) {
+            local_key = local_key ? local_key : std::make_shared<buffer_t>(format_desc.width * format_desc.height, 0);
+
+            draw(*local_key, 1, item, nullptr, nullptr, keyer::linear, format_desc);
+        } else if (item.transform.is_mix) {
+            local_mix = local_mix ? local_mix : std::make_shared<buffer_t>(target.size(), 0);
+
+            auto key = std::move(local_key);
+            draw(*local_mix, 4, item, key.get(), layer_key.get(), keyer::additive, format_desc);
+        } else {
+            composite(target, std::move(local_mix), core::blend_mode::normal, format_desc);
+
+            auto key = std::move(local_key);
+            draw(target, 4, item, key.get(), layer_key.get(), keyer::linear, format_desc);
+        }
+    }
+
+    // Rotation, perspective, custom geometry, levels, contrast/saturation/brightness and chroma key are not
+    // supported by the cpu mixer and are ignored.
+    void draw(buffer_t&                      target,
+              int                            target_stride,
+              const item&                    item,
+              const buffer_t*                local_key,
+              const buffer_t*                layer_key,
+              keyer                          keyer,
+              const core::video_format_desc& format_desc)
+    {
+        static const double epsilon = 0.001;
+
+        const auto& transform = item.transform;
+        const auto& planes    = item.pix_desc.planes;
+
+        if (planes.empty() || planes.size() != item.data.size()) {
+            return;
+        }
+
+        const auto opacity = transform.is_key ? 1.0 : transform.opacity;
+        if (opacity < epsilon) {
+            return;
+        }
+
+        const auto width  = format_desc.width;
+        const auto height = format_desc.height;
+
+        // Destination rectangle and its texture coordinates, see image_kernel for the equivalent vertex transform.
+        const auto& f_p    = transform.fill_translation;
+        const auto& f_s    = transform.fill_scale;
+        const auto& anchor = transform.anchor;
+        const auto& crop   = transform.crop;
+
+        double d[2][2];
+        double t[2][2];
+        for (int n = 0; n < 2; ++n) {
+            d[n][0] = f_p[n] + (crop.ul[n] - anchor[n]) * f_s[n];
+            d[n][1] = f_p[n] + (crop.lr[n] - anchor[n]) * f_s[n];
+            t[n][0] = crop.ul[n];
+            t[n][1] = crop.lr[n];
+
+            if (d[n][1] < d[n][0]) {
+                std::swap(d[n][0], d[n][1]);
+                std::swap(t[n][0], t[n][1]);
+            }
+
+            if (d[n][1] - d[n][0] < epsilon) {
+                return;
+            }
+        }
+
+        const auto& m_p = transform.clip_translation;
+        const auto& m_s = transform.clip_scale;
+
+        auto x0 = std::max({0, static_cast<int>(std::round(d[0][0] * width)), static_cast<int>(m_p[0] * width)});
+        auto x1 = std::min({width,
+                            static_cast<int>(std::round(d[0][1] * width)),
+                            static_cast<int>((m_p[0] + std::max(0.0, m_s[0])) * width)});
+        auto y0 = std::max({0, static_cast<int>(std::round(d[1][0] * height)), static_cast<int>(m_p[1] * height)});
+        auto y1 = std::min({height,
+                            static_cast<int>(std::round(d[1][1] * height)),
+                            static_cast<int>((m_p[1] + std::max(0.0, m_s[1])) * height)});
+
+        if (x1 <= x0 || y1 <= y0) {
+            return;
+        }
+
+        const auto count = x1 - x0;
+
+        // Source columns only depend on the destination column, so they are computed once per item and plane.
+        std::vector<std::vector<int>> columns(planes.size());
+        for (int p = 0; p < static_cast<int>(planes.size()); ++p) {
+            columns[p].resize(count);
+            for (int x = x0; x < x1; ++x) {
+                auto u = t[0][0] + ((x + 0.5) / width - d[0][0]) / (d[0][1] - d[0][0]) * (t[0][1] - t[0][0]);
+                columns[p][x - x0] = std::max(0, std::min(planes[p].width - 1, static_cast<int>(u * planes[p].width)));
+            }
+        }
+
+        const auto coverage_opacity = static_cast<int>(opacity * 255.0 + 0.5);
+
+        tbb::parallel_for(tbb::blocked_range<int>(y0, y1), [&](const tbb::blocked_range<int>& r) {
+            buffer_t                         row(count * 4);
+            buffer_t                         coverage(count);
+            std::vector<const std::uint8_t*> rows(planes.size());
+
+            for (auto y = r.begin(); y != r.end(); ++y) {
+                auto v = t[1][0] + ((y + 0.5) / height - d[1][0]) / (d[1][1] - d[1][0]) * (t[1][1] - t[1][0]);
+                for (int p = 0; p < static_cast<int>(planes.size()); ++p) {
+                    auto sy = std::max(0, std::min(planes[p].height - 1, static_cast<int>(v * planes[p].height)));
+                    rows[p] = item.data[p].data() + sy * planes[p].linesize;
+                }
+
+                sample_row(row.data(), item, rows, columns, count);
+
+                if (local_key || layer_key || coverage_opacity < 255) {
+                    auto offset = y * width + x0;
+                    for (int n = 0; n < count; ++n) {
+                        auto k = coverage_opacity;
+                        if (local_key) {
+                            k = div255(k * (*local_key)[offset + n]);
+                        }
+                        if (layer_key) {
+                            k = div255(k * (*layer_key)[offset + n]);
+                        }
+                        coverage[n] = static_cast<std::uint8_t>(k);
+                    }
+                    scale_row(row.data(), coverage.data(), count);
+                }
+
+                if (transform.invert) {
+                    for (auto& value : row) {
+                        value = static_cast<std::uint8_t>(255 - value);
+                    }
+                }
+
+                if (target_stride == 1) {
+                    blend_key_row(target.data() + y * width + x0, row.data(), count);
+                } else {
+                    blend_row(target.data() + (y * width + x0) * 4, row.data(), count, keyer);
+                }
+            }
+        });
+    }
+
+    void composite(buffer_t&                      target,
+                   std::shared_ptr<buffer_t>&&    source,
+                   core::blend_mode               blend_mode,
+                   const core::video_format_desc& format_desc)
+    {
+        if (!source)
+            return;
+
+        const auto width = format_desc.width;
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, format_desc.height), [&](const tbb::blocked_range<int>& r) {
+            for (auto y = r.begin(); y != r.end(); ++y) {
+                auto dst = target.data() + y * width * 4;
+                auto src = source->data() + y * width * 4;
+
+                if (blend_mode == core::blend_mode::normal) {
+                    blend_row(dst, src, width, keyer::linear);
+                    continue;
+                }
+
+                for (int n = 0; n < width; ++n) {
+                    auto fore_a = src[n * 4 + 3] / 255.0f;
+                    auto back_a = dst[n * 4 + 3] / 255.0f;
+                    for (int c = 0; c < 3; ++c) {
+                        auto fore  = src[n * 4 + c] / 255.0f / (fore_a + 0.0000001f);
+                        auto back  = dst[n * 4 + c] / 255.0f / (back_a + 0.0000001f);
+                        auto color = blend_channel(blend_mode, back, fore) * fore_a;
+                        auto value = color + (1.0f - fore_a) * dst[n * 4 + c] / 255.0f;
+                        dst[n * 4 + c] = clamp_byte(static_cast<int>(value * 255.0f + 0.5f));
+                    }
+                    dst[n * 4 + 3] =
+                        clamp_byte(static_cast<int>((fore_a + (1.0f - fore_a) * back_a) * 255.0f + 0.5f));
+                }
+            }
+        });
+    }
+};
+
+struct image_mixer::impl : public core::frame_factory
+{
+    image_renderer                     renderer_;
+    std::vector<core::image_transform> transform_stack_;
+    std::vector<layer>                 layers_; // layer/stream/items
+    std::vector<layer*>                layer_stack_;
+    executor                           executor_;
+
+  public:
+    impl(int channel_id)
+        : renderer_(channel_id)
+        , transform_stack_(1)
+        , executor_(L"cpu image mixer " + std::to_wstring(channel_id))
+    {
+        CASPAR_LOG(info) << L"Initialized CPU Image Mixer for channel " << channel_id;
+    }
+
+    void push(const core::frame_transform& transform)
+    {
+        auto previous_layer_depth = transform_stack_.back().layer_depth;
+        transform_stack_.push_back(transform_stack_.back() * transform.image_transform);
+        auto new_layer_depth = transform_stack_.back().layer_depth;
+
+        if (previous_layer_depth < new_layer_depth) {
+            layer new_layer(transform_stack_.back().blend_mode);
+
+            if (layer_stack_.empty()) {
+                layers_.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layers_.back());
+            } else {
+                layer_stack_.back()->sublayers.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layer_stack_.back()->sublayers.back());
+            }
+        }
+    }
+
+    void visit(const core::const_frame& frame)
+    {
+        if (frame.pixel_format_desc().format == core::pixel_format::invalid)
+            return;
+
+        if (frame.pixel_format_desc().planes.empty())
+            return;
+
+        item item;
+        item.pix_desc  = frame.pixel_format_desc();
+        item.transform = transform_stack_.back();
+        for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
+            item.data.push_back(frame.image_data(n));
+        }
+
+        layer_stack_.back()->items.push_back(std::move(item));
+    }
+
+    void pop()
+    {
+        transform_stack_.pop_back();
+        layer_stack_.resize(transform_stack_.back().layer_depth);
+    }
+
+    std::future<array<const std::uint8_t>> render(const core::video_format_desc& format_desc)
+    {
+        if (layers_.empty()) { // Bypass with empty frame.
+            static const std::vector<uint8_t> buffer(4096 * 4096 * 4, 0);
+            return make_ready_future(array<const std::uint8_t>(buffer.data(), format_desc.size, true));
+        }
+
+        auto layers = std::make_shared<std::vector<layer>>(std::move(layers_));
+        layers_.clear();
+
+        return executor_.begin_invoke([=] { return renderer_(std::move(*layers), format_desc); });
+    }
+
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        std::vector<array<std::uint8_t>> image_data;
+        for (auto& plane : desc.planes) {
+            image_data.push_back(array<std::uint8_t>(plane.size));
+        }
+
+        return core::mutable_frame(tag, std::move(image_data), array<int32_t>{}, desc);
+    }
+
+#ifdef WIN32
+    core::const_frame import_d3d_texture(const void*                                tag,
+                                         const std::shared_ptr<d3d::d3d_texture2d>& d3d_texture) override
+    {
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("D3D textures are not supported by the cpu mixer."));
+    }
+#endif
+};
+
+image_mixer::image_mixer(int channel_id)
+    : impl_(std::make_unique<impl>(channel_id))
+{
+}
+image_mixer::~image_mixer() {}
+void image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
+void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
+void image_mixer::pop() { impl_->pop(); }
+std::future<array<const std::uint8_t>> image_mixer::operator()(const core::video_format_desc& format_desc)
+{
+    return impl_->render(format_desc);
+}
+core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
+{
+    return impl_->create_frame(tag, desc);
+}
+
+#ifdef WIN32
+core::const_frame image_mixer::import_d3d_texture(const void*                                tag,
+                                                  const std::shared_ptr<d3d::d3d_texture2d>& d3d_texture)
+{
+    return impl_->import_d3d_texture(tag, d3d_texture);
+}
+#endif
+}}} // namespace caspar::accelerator::cpu
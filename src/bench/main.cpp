@@ -0,0 +1,694 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Headless end-to-end benchmark of the channel hot path.
+//
+// Starts a number of video channels fed by synthetic producers and drained by a null consumer, and prints
+// produce/mix/consume timings, dropped frames and per-thread cpu usage as JSON on stdout.
+
+#include <accelerator/accelerator.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/audio/audio_mixer.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <common/array.h>
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/memory.h>
+#include <common/tweener.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/range/algorithm/max_element.hpp>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace bench {
+
+struct options
+{
+    std::wstring config     = L"casparcg.config";
+    std::wstring format     = L"1080i5000";
+    int          channels   = 1;
+    int          layers     = 4;
+    int          frames     = 500;
+    int          warmup     = 50;
+    bool         noise      = false;
+    bool         audio      = true;
+    bool         transforms = false;
+    bool         clocked    = false;
+
+    bool audio_mixer    = false;
+    int  audio_channels = 0;
+};
+
+void print_usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  --config <file>      configuration file (default casparcg.config)\n"
+              << "  --format <name>      video format of every channel (default 1080i5000)\n"
+              << "  --channels <n>       number of channels (default 1)\n"
+              << "  --layers <n>         number of layers per channel (default 4)\n"
+              << "  --frames <n>         number of measured frames per channel (default 500)\n"
+              << "  --warmup <n>         number of frames to skip before measuring (default 50)\n"
+              << "  --source solid|noise content of the synthetic producers (default solid)\n"
+              << "  --no-audio           do not generate tone audio\n"
+              << "  --transforms         scale, offset and fade every layer with an animated transform\n"
+              << "  --clocked            run at the channel frame rate instead of as fast as possible\n"
+              << "\n"
+              << "  --audio-mixer        only benchmark the audio mixer, mixing one item per layer for every frame\n"
+              << "  --audio-channels <n> number of audio channels (default from the video format)\n";
+}
+
+options parse_options(int argc, char** argv)
+{
+    options opts;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+
+        auto next = [&]() -> std::string {
+            if (n + 1 >= argc)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value for " + arg));
+            return argv[++n];
+        };
+
+        if (arg == "--config")
+            opts.config = u16(next());
+        else if (arg == "--format")
+            opts.format = u16(next());
+        else if (arg == "--channels")
+            opts.channels = boost::lexical_cast<int>(next());
+        else if (arg == "--layers")
+            opts.layers = boost::lexical_cast<int>(next());
+        else if (arg == "--frames")
+            opts.frames = boost::lexical_cast<int>(next());
+        else if (arg == "--warmup")
+            opts.warmup = boost::lexical_cast<int>(next());
+        else if (arg == "--source")
+            opts.noise = next() == "noise";
+        else if (arg == "--no-audio")
+            opts.audio = false;
+        else if (arg == "--transforms")
+            opts.transforms = true;
+        else if (arg == "--clocked")
+            opts.clocked = true;
+        else if (arg == "--audio-mixer")
+            opts.audio_mixer = true;
+        else if (arg == "--audio-channels")
+            opts.audio_channels = boost::lexical_cast<int>(next());
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown option " + arg));
+    }
+
+    if (opts.channels < 1 || opts.layers < 1 || opts.frames < 1 || opts.warmup < 0 || opts.audio_channels < 0)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid option value"));
+
+    return opts;
+}
+
+// Full frame bgra producer with optional tone audio. Every frame is freshly allocated and filled, either with a
+// solid color or with noise, so that the cost of producing and uploading new content is part of the measurement.
+class synthetic_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const core::video_format_desc              format_desc_;
+    const bool                                 noise_;
+    const bool                                 audio_;
+    const uint32_t                             color_;
+    const double                               frequency_;
+    uint32_t                                   seed_;
+    int64_t                                    sample_ = 0;
+
+  public:
+    synthetic_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                       const core::video_format_desc&              format_desc,
+                       int                                         index,
+                       bool                                        noise,
+                       bool                                        audio)
+        : frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+        , noise_(noise)
+        , audio_(audio)
+        , color_(0xFF000000 | (0x3F << ((index % 3) * 8)))
+        , frequency_(220.0 * (index + 1))
+        , seed_(2463534242u + index)
+    {
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width, format_desc_.height, 4));
+        auto frame = frame_factory_->create_frame(this, desc);
+
+        auto dest = reinterpret_cast<uint32_t*>(frame.image_data(0).begin());
+        auto size = static_cast<std::size_t>(format_desc_.width) * format_desc_.height;
+
+        if (noise_) {
+            for (std::size_t n = 0; n < size; ++n) {
+                seed_ ^= seed_ << 13;
+                seed_ ^= seed_ >> 17;
+                seed_ ^= seed_ << 5;
+                dest[n] = seed_ | 0xFF000000;
+            }
+        } else {
+            std::fill(dest, dest + size, color_);
+        }
+
+        if (audio_ && nb_samples > 0) {
+            static const double pi       = 3.14159265358979323846;
+            const auto          channels = format_desc_.audio_channels;
+
+            std::vector<int32_t> samples(static_cast<std::size_t>(nb_samples) * channels);
+            for (int n = 0; n < nb_samples; ++n, ++sample_) {
+                auto value = static_cast<int32_t>(
+                    std::sin(2.0 * pi * frequency_ * sample_ / format_desc_.audio_sample_rate) * 0.25 *
+                    std::numeric_limits<int32_t>::max());
+                std::fill_n(samples.begin() + n * channels, channels, value);
+            }
+            frame.audio_data() = array<int32_t>(std::move(samples));
+        }
+
+        return core::draw_frame(std::move(frame));
+    }
+
+    std::wstring print() const override { return L"synthetic[" + std::wstring(noise_ ? L"noise" : L"solid") + L"]"; }
+    std::wstring name() const override { return L"synthetic"; }
+};
+
+class null_consumer : public core::frame_consumer
+{
+    const bool clocked_;
+
+  public:
+    explicit null_consumer(bool clocked)
+        : clocked_(clocked)
+    {
+    }
+
+    // frame_consumer
+
+    std::future<bool> send(core::const_frame frame) override { return make_ready_future(true); }
+    void              initialize(const core::video_format_desc& format_desc, int channel_index) override {}
+    std::wstring      print() const override { return L"null[]"; }
+    std::wstring      name() const override { return L"null"; }
+    int               index() const override { return 1000; }
+
+    // Claiming the clock stops output from pacing the channel, which makes it run as fast as possible.
+    bool has_synchronization_clock() const override { return !clocked_; }
+};
+
+// Collects the values and tags that a channel reports to its diagnostics graph. One sink is created per graph.
+class recording_sink : public diagnostics::spi::graph_sink
+{
+    const std::atomic<bool>& recording_;
+
+    mutable std::mutex                         mutex_;
+    std::wstring                               text_;
+    std::map<std::string, std::vector<double>> values_;
+    std::map<std::string, int>                 tags_;
+
+  public:
+    explicit recording_sink(const std::atomic<bool>& recording)
+        : recording_(recording)
+    {
+    }
+
+    void activate() override {}
+    void set_color(const std::string& name, int color) override {}
+    void auto_reset() override {}
+
+    void set_text(const std::wstring& value) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        text_ = value;
+    }
+
+    void set_value(const std::string& name, double value) override
+    {
+        if (!recording_)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        values_[name].push_back(value);
+    }
+
+    void set_tag(diagnostics::tag_severity severity, const std::string& name) override
+    {
+        if (!recording_)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        tags_[name] += 1;
+    }
+
+    std::wstring text() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return text_;
+    }
+
+    std::map<std::string, std::vector<double>> values() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return values_;
+    }
+
+    std::map<std::string, int> tags() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return tags_;
+    }
+};
+
+using clock_type   = std::chrono::steady_clock;
+using time_point_t = clock_type::time_point;
+
+struct channel_ticks
+{
+    std::vector<time_point_t> times;
+};
+
+struct thread_time
+{
+    std::string name;
+    double      cpu = 0.0; // seconds
+};
+
+// Cpu time per thread of this process, keyed by thread id.
+std::map<int, thread_time> thread_times()
+{
+    std::map<int, thread_time> result;
+#ifndef WIN32
+    static const double ticks_per_second = static_cast<double>(sysconf(_SC_CLK_TCK));
+
+    boost::system::error_code ec;
+    for (boost::filesystem::directory_iterator it("/proc/self/task", ec), end; !ec && it != end; it.increment(ec)) {
+        std::ifstream stat_file((it->path() / "stat").string());
+        std::string   stat;
+        std::getline(stat_file, stat);
+
+        // The thread name is enclosed in parentheses and may itself contain spaces.
+        auto name_begin = stat.find('(');
+        auto name_end   = stat.rfind(')');
+        if (name_begin == std::string::npos || name_end == std::string::npos)
+            continue;
+
+        std::istringstream fields(stat.substr(name_end + 2));
+        std::string        field;
+        unsigned long long utime = 0;
+        unsigned long long stime = 0;
+
+        // utime and stime are the 14th and 15th fields, the state is the 3rd.
+        for (int n = 3; n < 14 && fields >> field; ++n) {
+        }
+        if (!(fields >> utime >> stime))
+            continue;
+
+        auto& entry = result[boost::lexical_cast<int>(it->path().filename().string())];
+        entry.name  = stat.substr(name_begin + 1, name_end - name_begin - 1);
+        entry.cpu   = static_cast<double>(utime + stime) / ticks_per_second;
+    }
+#endif
+    return result;
+}
+
+std::string escape(const std::string& str)
+{
+    std::string result;
+    for (auto c : str) {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20)
+            result += c;
+    }
+    return result;
+}
+
+void write_stats(std::ostream& out, std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+
+    auto percentile = [&](double p) {
+        return samples.empty() ? 0.0 : samples[static_cast<std::size_t>(std::ceil(p * samples.size())) - 1];
+    };
+
+    out << "{\"count\": " << samples.size() << ", \"p50\": " << percentile(0.50) << ", \"p99\": " << percentile(0.99)
+        << ", \"max\": " << (samples.empty() ? 0.0 : samples.back()) << "}";
+}
+
+// Runs the audio mixer on its own, without channels or configuration. Every layer contributes one item per frame.
+// With a single layer and no transforms the unity gain passthrough is measured, with --transforms every item is
+// attenuated and every second item is one sample frame short so that padding is part of the measurement.
+int run_audio_mixer(const options& opts)
+{
+    auto format_desc = core::video_format_desc(opts.format);
+    if (format_desc.format == core::video_format::invalid)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + opts.format));
+
+    if (opts.audio_channels > 0)
+        format_desc.audio_channels = opts.audio_channels;
+
+    const auto channels   = format_desc.audio_channels;
+    const auto nb_samples = *boost::max_element(format_desc.audio_cadence);
+
+    std::vector<core::const_frame> frames;
+    for (int layer = 0; layer < opts.layers; ++layer) {
+        auto short_item = opts.transforms && layer % 2 == 1;
+        auto count      = static_cast<std::size_t>(nb_samples - (short_item ? 1 : 0)) * channels;
+
+        std::vector<int32_t> samples(count);
+        for (std::size_t n = 0; n < count; ++n) {
+            samples[n] = static_cast<int32_t>(std::sin(n * 0.01 * (layer + 1)) * 0.25 *
+                                              std::numeric_limits<int32_t>::max());
+        }
+        frames.emplace_back(std::vector<array<const std::uint8_t>>{},
+                            array<const std::int32_t>(array<std::int32_t>(std::move(samples))),
+                            core::pixel_format_desc());
+    }
+
+    core::frame_transform transform;
+    if (opts.transforms)
+        transform.audio_transform.volume = 0.5;
+
+    core::audio_mixer mixer(spl::make_shared<diagnostics::graph>());
+
+    std::vector<double> times;
+    times.reserve(opts.frames);
+
+    for (int frame = 0; frame < opts.warmup + opts.frames; ++frame) {
+        auto start = clock_type::now();
+
+        for (auto& item : frames) {
+            mixer.push(transform);
+            mixer.visit(item);
+            mixer.pop();
+        }
+        auto result = mixer(format_desc, nb_samples);
+
+        auto elapsed = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+        if (frame >= opts.warmup)
+            times.push_back(elapsed);
+    }
+
+    auto total = std::accumulate(times.begin(), times.end(), 0.0);
+
+    std::ostringstream out;
+    out << "{\n";
+    out << "  \"format\": \"" << u8(format_desc.name) << "\",\n";
+    out << "  \"audio-channels\": " << channels << ",\n";
+    out << "  \"samples\": " << nb_samples << ",\n";
+    out << "  \"layers\": " << opts.layers << ",\n";
+    out << "  \"transforms\": " << (opts.transforms ? "true" : "false") << ",\n";
+    out << "  \"mix-time\": ";
+    write_stats(out, times);
+    out << ",\n";
+    out << "  \"samples-per-second\": "
+        << (total > 0.0 ? static_cast<double>(nb_samples) * channels * opts.layers * times.size() / total * 1e3 : 0.0)
+        << "\n}\n";
+
+    std::cout << out.str() << std::flush;
+
+    return 0;
+}
+
+int run(const options& opts)
+{
+    if (opts.audio_mixer)
+        return run_audio_mixer(opts);
+
+    env::configure(opts.config);
+
+    auto format_desc = core::video_format_desc(opts.format);
+    if (format_desc.format == core::video_format::invalid)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + opts.format));
+
+    std::atomic<bool>                            recording{false};
+    std::mutex                                   sinks_mutex;
+    std::vector<std::shared_ptr<recording_sink>> sinks;
+
+    diagnostics::spi::register_sink_factory([&] {
+        auto sink = spl::make_shared<recording_sink>(recording);
+        std::lock_guard<std::mutex> lock(sinks_mutex);
+        sinks.push_back(sink);
+        return sink;
+    });
+
+    std::mutex                 ticks_mutex;
+    std::condition_variable    ticks_cond;
+    std::vector<channel_ticks> ticks(opts.channels);
+    std::vector<int>           frame_counts(opts.channels, 0);
+
+    accelerator::accelerator                          accelerator;
+    std::vector<spl::shared_ptr<core::video_channel>> channels;
+
+    for (int n = 0; n < opts.channels; ++n) {
+        auto channel_id = n + 1;
+        channels.push_back(spl::make_shared<core::video_channel>(
+            channel_id, format_desc, accelerator.create_image_mixer(channel_id), [&, n](const std::function<core::monitor::state()>&) {
+                std::lock_guard<std::mutex> lock(ticks_mutex);
+                frame_counts[n] += 1;
+                if (recording) {
+                    ticks[n].times.push_back(clock_type::now());
+                }
+                ticks_cond.notify_all();
+            }));
+    }
+
+    for (auto& channel : channels) {
+        channel->output().add(spl::make_shared<null_consumer>(opts.clocked));
+
+        for (int layer = 0; layer < opts.layers; ++layer) {
+            auto index = (layer + 1) * 10;
+
+            channel->stage()
+                .load(index,
+                      spl::make_shared<synthetic_producer>(
+                          channel->frame_factory(), format_desc, layer, opts.noise, opts.audio),
+                      false,
+                      true)
+                .get();
+
+            if (opts.transforms) {
+                auto scale  = 1.0 - 0.5 * layer / opts.layers;
+                auto offset = 0.5 * layer / opts.layers;
+                channel->stage()
+                    .apply_transform(index,
+                                     [=](core::frame_transform transform) {
+                                         transform.image_transform.fill_scale       = {scale, scale};
+                                         transform.image_transform.fill_translation = {offset, offset};
+                                         transform.image_transform.opacity          = 0.8;
+                                         transform.audio_transform.volume           = 0.5;
+                                         return transform;
+                                     },
+                                     opts.warmup + opts.frames,
+                                     tweener(L"easeinoutsine"))
+                    .get();
+            }
+        }
+    }
+
+    auto wait_for_frames = [&](int count) {
+        std::unique_lock<std::mutex> lock(ticks_mutex);
+        ticks_cond.wait(lock, [&] {
+            return std::all_of(frame_counts.begin(), frame_counts.end(), [&](int n) { return n >= count; });
+        });
+    };
+
+    wait_for_frames(opts.warmup);
+
+    auto threads_before = thread_times();
+    auto start          = clock_type::now();
+    recording           = true;
+
+    wait_for_frames(opts.warmup + opts.frames);
+
+    recording          = false;
+    auto elapsed       = std::chrono::duration<double>(clock_type::now() - start).count();
+    auto threads_after = thread_times();
+
+    const auto frame_duration = 1.0 / format_desc.fps;
+
+    std::ostringstream out;
+    out << "{\n";
+    out << "  \"format\": \"" << u8(format_desc.name) << "\",\n";
+    out << "  \"accelerator\": \"" << u8(env::properties().get(L"configuration.accelerator", L"gpu")) << "\",\n";
+    out << "  \"clocked\": " << (opts.clocked ? "true" : "false") << ",\n";
+    out << "  \"layers\": " << opts.layers << ",\n";
+    out << "  \"source\": \"" << (opts.noise ? "noise" : "solid") << "\",\n";
+    out << "  \"audio\": " << (opts.audio ? "true" : "false") << ",\n";
+    out << "  \"transforms\": " << (opts.transforms ? "true" : "false") << ",\n";
+    out << "  \"elapsed\": " << elapsed << ",\n";
+    out << "  \"channels\": [";
+
+    {
+        std::lock_guard<std::mutex> sinks_lock(sinks_mutex);
+        std::lock_guard<std::mutex> ticks_lock(ticks_mutex);
+
+        for (int n = 0; n < opts.channels; ++n) {
+            auto prefix = L"video_channel[" + std::to_wstring(n + 1) + L"|";
+            auto sink   = std::find_if(sinks.begin(), sinks.end(), [&](const std::shared_ptr<recording_sink>& s) {
+                return boost::starts_with(s->text(), prefix);
+            });
+
+            auto& times  = ticks[n].times;
+            auto  values = sink != sinks.end() ? (*sink)->values() : std::map<std::string, std::vector<double>>{};
+            auto  tags   = sink != sinks.end() ? (*sink)->tags() : std::map<std::string, int>{};
+
+            // Graph values are normalized so that 0.5 equals one frame duration.
+            for (auto& p : values) {
+                for (auto& value : p.second) {
+                    value = value * 2.0 * frame_duration * 1000.0;
+                }
+            }
+
+            // A clocked channel drops a frame whenever a tick arrives later than one frame after the previous one.
+            // An unclocked channel would drop a frame whenever a full tick takes longer than one frame.
+            int dropped = 0;
+            if (opts.clocked) {
+                for (std::size_t i = 1; i < times.size(); ++i) {
+                    auto interval = std::chrono::duration<double>(times[i] - times[i - 1]).count();
+                    dropped += std::max(0, static_cast<int>(std::round(interval / frame_duration)) - 1);
+                }
+            } else {
+                for (auto value : values["frame-time"]) {
+                    if (value > frame_duration * 1000.0)
+                        dropped += 1;
+                }
+            }
+
+            auto fps = times.size() > 1
+                           ? (times.size() - 1) / std::chrono::duration<double>(times.back() - times.front()).count()
+                           : 0.0;
+
+            out << (n > 0 ? ",\n" : "\n") << "    {\n";
+            out << "      \"index\": " << n + 1 << ",\n";
+            out << "      \"frames\": " << times.size() << ",\n";
+            out << "      \"fps\": " << fps << ",\n";
+            out << "      \"dropped\": " << dropped << ",\n";
+            out << "      \"times\": {";
+
+            bool first = true;
+            for (auto& p : values) {
+                if (!boost::ends_with(p.first, "-time"))
+                    continue;
+                out << (first ? "\n" : ",\n") << "        \"" << escape(p.first) << "\": ";
+                write_stats(out, p.second);
+                first = false;
+            }
+            out << "\n      },\n";
+
+            out << "      \"tags\": {";
+            first = true;
+            for (auto& p : tags) {
+                out << (first ? "" : ", ") << "\"" << escape(p.first) << "\": " << p.second;
+                first = false;
+            }
+            out << "}\n    }";
+        }
+    }
+
+    out << "\n  ],\n";
+    out << "  \"threads\": [";
+
+    bool first = true;
+    for (auto& p : threads_after) {
+        auto before = threads_before.find(p.first);
+        auto cpu    = p.second.cpu - (before != threads_before.end() ? before->second.cpu : 0.0);
+        out << (first ? "\n" : ",\n") << "    {\"id\": " << p.first << ", \"name\": \"" << escape(p.second.name)
+            << "\", \"cpu\": " << cpu << ", \"usage\": " << (elapsed > 0.0 ? cpu / elapsed : 0.0) << "}";
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+
+    std::cout << out.str() << std::flush;
+
+    for (auto& channel : channels) {
+        channel->stage().clear().get();
+    }
+    channels.clear();
+
+    core::stop_producer_construction();
+    core::destroy_producers_synchronously();
+    core::destroy_consumers_synchronously();
+
+    return 0;
+}
+
+}} // namespace caspar::bench
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    for (int n = 1; n < argc; ++n) {
+        if (std::string(argv[n]) == "--help" || std::string(argv[n]) == "-h") {
+            bench::print_usage(argv[0]);
+            return 0;
+        }
+    }
+
+    try {
+        log::set_log_level(L"warning");
+        return bench::run(bench::parse_options(argc, argv));
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        bench::print_usage(argv[0]);
+        return 1;
+    }
+}
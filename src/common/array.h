@@ -70,6 +70,16 @@ class array final
         return *this;
     }
 
+    // Another reference to the same memory, for an owner that needs to keep it alive after handing this one on.
+    array share() const
+    {
+        array result;
+        result.ptr_     = ptr_;
+        result.size_    = size_;
+        result.storage_ = storage_;
+        return result;
+    }
+
     T*          begin() const { return ptr_; }
     T*          data() const { return ptr_; }
     T*          end() const { return ptr_ + size_; }
@@ -112,6 +112,10 @@ void configure(const std::wstring& filename)
     ensure_writable(log);
     ensure_writable(ftemplate);
     ensure_writable(data);
+
+    index_case_insensitive(media);
+    index_case_insensitive(ftemplate);
+    index_case_insensitive(data);
 }
 
 const std::wstring& initial_folder()
@@ -21,14 +21,30 @@
 
 #pragma once
 
+#include <functional>
 #include <string>
+#include <vector>
 
 #include <boost/optional.hpp>
 
 namespace caspar {
 
+// Keeps an in-memory, case folded index of folder and everything below it, so that lookups of what it holds do not
+// touch the disk. Misses are final in watched folders, and looked up on the disk below symbolic links and network
+// filesystems, which are not watched. A no-op where the filesystem is case insensitive.
+void index_case_insensitive(const std::wstring& folder);
+
+// Indexes folder and calls handler, from the thread keeping the index current, with the actual path of anything
+// created, written, moved or removed below it. The path of folder itself means anything below it may have changed.
+// The handler must not block. Returns false if changes to folder can not be reported, in which case it has to be
+// polled.
+bool watch_case_insensitive(const std::wstring& folder, std::function<void(const std::wstring&)> handler);
+
 boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive);
 
+// Files in the directory of stem whose name without extension matches the last component of stem, ignoring case.
+std::vector<std::wstring> find_case_insensitive_stem(const std::wstring& stem);
+
 std::wstring clean_path(std::wstring path);
 
 std::wstring ensure_trailing_slash(std::wstring folder);
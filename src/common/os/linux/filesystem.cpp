@@ -22,17 +22,79 @@
 #include "../../stdafx.h"
 
 #include "../filesystem.h"
+#include "../thread.h"
 
+#include "../../log.h"
+#include "../../utf.h"
+
+#include <atomic>
+#include <cstdint>
 #include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
 using namespace boost::filesystem;
 
 namespace caspar {
 
-boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive)
+namespace {
+
+std::wstring fold(const std::wstring& str) { return boost::algorithm::to_lower_copy(str); }
+
+// Case folded, lexically normalized form of an absolute path. None for paths that step up with "..", which can not
+// be normalized without asking the disk.
+boost::optional<std::wstring> folded_key(const path& p)
+{
+    std::wstring result;
+    for (auto& part : absolute(p)) {
+        auto str = part.wstring();
+        if (str == L"/" || str.empty() || str == L".") {
+            continue;
+        }
+        if (str == L"..") {
+            return boost::none;
+        }
+        result += L"/" + fold(str);
+    }
+    return result;
+}
+
+std::wstring folded_stem_key(const std::wstring& parent_key, const path& p)
+{
+    return parent_key + L"/" + fold(p.stem().wstring());
+}
+
+// inotify does not report changes made by other hosts to network filesystems, so those are left to the disk.
+bool is_network_filesystem(const std::wstring& dir)
+{
+    struct statfs buf;
+    if (statfs(u8(dir).c_str(), &buf) != 0) {
+        return false;
+    }
+
+    switch (static_cast<std::uint32_t>(buf.f_type)) {
+        case 0x6969:     // NFS
+        case 0x517B:     // SMB
+        case 0xFF534D42: // CIFS
+        case 0xFE534D42: // SMB2
+        case 0x65735546: // FUSE
+            return true;
+        default:
+            return false;
+    }
+}
+
+boost::optional<std::wstring> find_on_disk(const std::wstring& case_insensitive)
 {
     path p(case_insensitive);
 
@@ -68,6 +130,454 @@ boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_ins
     return result.wstring();
 }
 
+// In-memory index of the indexed folders, keyed by case folded path and by case folded path without extension.
+// Kept current with inotify; should a watch fail or the event queue overflow, lookups fall back to the disk until the
+// folders have been rescanned. A path missing from the index is only known not to exist if its parent is a watched
+// folder. Symbolic links to folders and network filesystems are not watched, so lookups below them go to the disk.
+class path_index
+{
+    // The paths and watches found by walking a folder, merged into the index once the walk is done.
+    struct tree
+    {
+        std::vector<std::pair<std::wstring, std::wstring>> paths;   // folded key, actual path
+        std::vector<std::pair<int, std::wstring>>          watches; // descriptor, actual path
+        bool                                               complete = true;
+    };
+
+    std::mutex                                                  mutex_;
+    std::vector<std::pair<std::wstring, std::wstring>>          roots_; // folded key, actual path
+    std::unordered_map<std::wstring, std::wstring>              paths_;
+    std::unordered_map<std::wstring, std::vector<std::wstring>> stems_;
+    std::unordered_map<int, std::wstring>                       watches_;
+    std::unordered_set<std::wstring>                            watched_; // folded keys of watched folders
+    bool                                                        complete_ = true;
+
+    // Folded key and handler of each watched folder.
+    std::vector<std::pair<std::wstring, std::function<void(const std::wstring&)>>> handlers_;
+
+    int               fd_ = -1;
+    std::atomic<bool> abort_{false};
+    std::thread       thread_;
+
+    void add(const std::wstring& key, const std::wstring& actual)
+    {
+        if (!paths_.emplace(key, actual).second) {
+            return;
+        }
+        auto parent = key.substr(0, key.rfind(L'/'));
+        stems_[folded_stem_key(parent, actual)].push_back(actual);
+    }
+
+    void remove(const std::wstring& key)
+    {
+        auto it = paths_.find(key);
+        if (it == paths_.end()) {
+            return;
+        }
+
+        auto parent = key.substr(0, key.rfind(L'/'));
+        auto stem   = stems_.find(folded_stem_key(parent, it->second));
+        if (stem != stems_.end()) {
+            auto& paths = stem->second;
+            paths.erase(std::remove(paths.begin(), paths.end(), it->second), paths.end());
+            if (paths.empty()) {
+                stems_.erase(stem);
+            }
+        }
+        paths_.erase(it);
+    }
+
+    void remove_tree(const std::wstring& key, const std::wstring& actual)
+    {
+        // A folder moved out of the tree is still watched, under a path it no longer has.
+        std::vector<int> wds;
+        for (auto& w : watches_) {
+            if (w.second == actual || boost::algorithm::starts_with(w.second, actual + L"/")) {
+                wds.push_back(w.first);
+            }
+        }
+        for (auto wd : wds) {
+            inotify_rm_watch(fd_, wd);
+            watches_.erase(wd);
+        }
+
+        for (auto it = watched_.begin(); it != watched_.end();) {
+            if (*it == key || boost::algorithm::starts_with(*it, key + L"/")) {
+                it = watched_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        std::vector<std::wstring> keys;
+        for (auto& p : paths_) {
+            if (boost::algorithm::starts_with(p.first, key + L"/")) {
+                keys.push_back(p.first);
+            }
+        }
+        for (auto& k : keys) {
+            remove(k);
+        }
+        remove(key);
+    }
+
+    void notify(const std::wstring& key, const std::wstring& actual)
+    {
+        for (auto& handler : handlers_) {
+            if (key == handler.first || boost::algorithm::starts_with(key, handler.first + L"/")) {
+                handler.second(actual);
+            }
+        }
+    }
+
+    void watch(const std::wstring& dir, tree& result) const
+    {
+        auto wd = inotify_add_watch(fd_,
+                                    u8(dir).c_str(),
+                                    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+                                        IN_DELETE_SELF | IN_ONLYDIR);
+        if (wd < 0) {
+            CASPAR_LOG(warning) << L"[filesystem] Failed to watch " << dir << L", falling back to disk lookups.";
+            result.complete = false;
+            return;
+        }
+        result.watches.emplace_back(wd, dir);
+    }
+
+    // Walks dir without touching the index, so that lookups are not held up by it. Watches are added before listing,
+    // so nothing created during the walk is missed.
+    tree walk(const std::wstring& key, const std::wstring& dir) const
+    {
+        tree result;
+        result.paths.emplace_back(key, dir);
+        watch(dir, result);
+
+        boost::system::error_code ec;
+        for (auto it = recursive_directory_iterator(dir, ec); !ec && it != recursive_directory_iterator();
+             it.increment(ec)) {
+            auto actual = it->path().wstring();
+            auto rel    = actual.substr(dir.size());
+            result.paths.emplace_back(key + fold(rel), actual);
+            if (is_directory(it->symlink_status())) {
+                if (is_network_filesystem(actual)) {
+                    it.no_push();
+                } else {
+                    watch(actual, result);
+                }
+            }
+        }
+        if (ec) {
+            CASPAR_LOG(warning) << L"[filesystem] Failed to index " << dir << L": " << u16(ec.message());
+            result.complete = false;
+        }
+        return result;
+    }
+
+    void merge(const tree& result)
+    {
+        for (auto& p : result.paths) {
+            add(p.first, p.second);
+        }
+        for (auto& w : result.watches) {
+            auto key = folded_key(w.second);
+            if (key) {
+                watches_[w.first] = w.second;
+                watched_.insert(*key);
+            }
+        }
+        complete_ = complete_ && result.complete;
+    }
+
+    // Called without the lock, the folders are walked without it and the index is replaced once they have been.
+    void rescan()
+    {
+        std::vector<std::pair<std::wstring, std::wstring>> roots;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& w : watches_) {
+                inotify_rm_watch(fd_, w.first);
+            }
+            watches_.clear();
+            watched_.clear();
+            paths_.clear();
+            stems_.clear();
+            complete_ = false;
+            roots     = roots_;
+        }
+
+        std::vector<tree> trees;
+        for (auto& root : roots) {
+            trees.push_back(walk(root.first, root.second));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        complete_ = true;
+        for (auto& result : trees) {
+            merge(result);
+        }
+        for (auto& root : roots) {
+            notify(root.first, root.second);
+        }
+    }
+
+    // Applies event to the index. Returns the folded key and actual path of a folder created or moved into the tree,
+    // which the caller walks once it has released the lock.
+    boost::optional<std::pair<std::wstring, std::wstring>> handle(const inotify_event* event)
+    {
+        auto it = watches_.find(event->wd);
+        if (it == watches_.end()) {
+            return boost::none;
+        }
+
+        if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+            auto key = folded_key(it->second);
+            if (key) {
+                watched_.erase(*key);
+            }
+            watches_.erase(it);
+            return boost::none;
+        }
+
+        if (event->len == 0) {
+            return boost::none;
+        }
+
+        auto actual = it->second + L"/" + u16(event->name);
+        auto key    = folded_key(actual);
+        if (!key) {
+            return boost::none;
+        }
+
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            if (event->mask & IN_ISDIR) {
+                return std::make_pair(*key, actual);
+            }
+            add(*key, actual);
+        } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            remove_tree(*key, actual);
+        }
+
+        notify(*key, actual);
+        return boost::none;
+    }
+
+    void run()
+    {
+        set_thread_name(L"path_index");
+
+        std::vector<char> buffer(64 * 1024);
+
+        while (!abort_) {
+            pollfd pfd = {fd_, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) {
+                continue;
+            }
+
+            auto size = read(fd_, buffer.data(), buffer.size());
+            if (size <= 0) {
+                continue;
+            }
+
+            // Events are only read by this thread, so events for folders being walked wait in the queue until they
+            // have been merged.
+            for (auto offset = 0L; offset < size;) {
+                auto event = reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+                offset += sizeof(inotify_event) + event->len;
+
+                try {
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        CASPAR_LOG(warning) << L"[filesystem] Event queue overflow, rescanning indexed folders.";
+                        rescan();
+                        continue;
+                    }
+
+                    boost::optional<std::pair<std::wstring, std::wstring>> dir;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        dir = handle(event);
+                    }
+                    if (!dir) {
+                        continue;
+                    }
+
+                    auto result = walk(dir->first, dir->second);
+
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    merge(result);
+                    notify(dir->first, dir->second);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        }
+    }
+
+    const std::pair<std::wstring, std::wstring>* root_of(const std::wstring& key) const
+    {
+        for (auto& root : roots_) {
+            if (key == root.first || boost::algorithm::starts_with(key, root.first + L"/")) {
+                return &root;
+            }
+        }
+        return nullptr;
+    }
+
+  public:
+    static path_index& instance()
+    {
+        static path_index index;
+        return index;
+    }
+
+    ~path_index()
+    {
+        abort_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    void index(const std::wstring& folder)
+    {
+        auto actual = find_on_disk(folder);
+        auto key    = actual ? folded_key(*actual) : boost::none;
+        if (!key) {
+            return;
+        }
+
+        auto dir = path(*actual).wstring();
+        while (dir.size() > 1 && dir.back() == L'/') {
+            dir.pop_back();
+        }
+
+        if (is_network_filesystem(dir)) {
+            CASPAR_LOG(info) << L"[filesystem] " << dir << L" is on a network filesystem and is not indexed.";
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (root_of(*key)) {
+            return;
+        }
+
+        if (fd_ < 0) {
+            fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (fd_ < 0) {
+                CASPAR_LOG(warning) << L"[filesystem] inotify unavailable, media paths are not indexed.";
+                return;
+            }
+            thread_ = std::thread([this] { run(); });
+        }
+
+        roots_.emplace_back(*key, dir);
+        merge(walk(*key, dir));
+
+        CASPAR_LOG(info) << L"[filesystem] Indexed " << paths_.size() << L" paths, including " << dir << L".";
+    }
+
+    bool watch(const std::wstring& folder, std::function<void(const std::wstring&)> handler)
+    {
+        index(folder);
+
+        auto actual = find_on_disk(folder);
+        auto key    = actual ? folded_key(*actual) : boost::none;
+        if (!key) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!complete_ || !root_of(*key)) {
+            return false;
+        }
+
+        handlers_.emplace_back(*key, std::move(handler));
+        return true;
+    }
+
+    // Looks up the actual path of key. Returns false if the index can not tell, in which case the disk has to be
+    // asked: outside the indexed folders, below folders that are not watched, or while the index is incomplete.
+    bool find(const std::wstring& key, boost::optional<std::wstring>& result)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!complete_ || !root_of(key)) {
+            return false;
+        }
+
+        auto it = paths_.find(key);
+        if (it != paths_.end()) {
+            result = it->second;
+            return true;
+        }
+
+        result = boost::none;
+        return watched_.count(key.substr(0, key.rfind(L'/'))) > 0;
+    }
+
+    bool find_stem(const std::wstring& key, std::vector<std::wstring>& result)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!complete_ || !root_of(key)) {
+            return false;
+        }
+
+        auto it = stems_.find(key);
+        result  = it != stems_.end() ? it->second : std::vector<std::wstring>();
+        return !result.empty() || watched_.count(key.substr(0, key.rfind(L'/'))) > 0;
+    }
+};
+
+} // namespace
+
+void index_case_insensitive(const std::wstring& folder) { path_index::instance().index(folder); }
+
+bool watch_case_insensitive(const std::wstring& folder, std::function<void(const std::wstring&)> handler)
+{
+    return path_index::instance().watch(folder, std::move(handler));
+}
+
+boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive)
+{
+    auto key = folded_key(case_insensitive);
+
+    boost::optional<std::wstring> result;
+    if (key && path_index::instance().find(*key, result)) {
+        return result;
+    }
+
+    return find_on_disk(case_insensitive);
+}
+
+std::vector<std::wstring> find_case_insensitive_stem(const std::wstring& stem)
+{
+    auto key = folded_key(stem);
+
+    std::vector<std::wstring> result;
+    if (key && path_index::instance().find_stem(*key, result)) {
+        return result;
+    }
+
+    auto p      = path(stem);
+    auto parent = find_on_disk(p.parent_path().wstring());
+    if (!parent) {
+        return result;
+    }
+
+    boost::system::error_code ec;
+    for (auto it = directory_iterator(*parent, ec); !ec && it != directory_iterator(); it.increment(ec)) {
+        if (boost::algorithm::iequals(it->path().stem().wstring(), p.filename().wstring())) {
+            result.push_back(it->path().wstring());
+        }
+    }
+    return result;
+}
+
 std::wstring clean_path(std::wstring path)
 {
     boost::replace_all(path, L"\\\\", L"/");
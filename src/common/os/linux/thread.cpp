@@ -1,8 +1,16 @@
 #include "../thread.h"
 #include "../../utf.h"
 
+#include <pthread.h>
+
 namespace caspar {
 
 void set_thread_name(const std::wstring& name) { pthread_setname_np(pthread_self(), u8(name).c_str()); }
 
+void set_thread_low_priority()
+{
+    sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+}
+
 } // namespace caspar
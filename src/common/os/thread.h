@@ -5,4 +5,7 @@
 namespace caspar {
 
 void set_thread_name(const std::wstring& name);
+
+// Lets the calling thread run only when nothing more important needs the CPU.
+void set_thread_low_priority();
 }
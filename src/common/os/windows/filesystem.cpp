@@ -24,10 +24,18 @@
 #include "../filesystem.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/trim.hpp>
 
 namespace caspar {
 
+void index_case_insensitive(const std::wstring& folder) {}
+
+bool watch_case_insensitive(const std::wstring& folder, std::function<void(const std::wstring&)> handler)
+{
+    return false;
+}
+
 boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive)
 {
     if (boost::filesystem::exists(case_insensitive))
@@ -35,6 +43,24 @@ boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_ins
     return boost::none;
 }
 
+std::vector<std::wstring> find_case_insensitive_stem(const std::wstring& stem)
+{
+    std::vector<std::wstring> result;
+
+    auto p = boost::filesystem::path(stem);
+    if (!boost::filesystem::is_directory(p.parent_path()))
+        return result;
+
+    boost::system::error_code ec;
+    for (auto it = boost::filesystem::directory_iterator(p.parent_path(), ec);
+         !ec && it != boost::filesystem::directory_iterator();
+         it.increment(ec)) {
+        if (boost::algorithm::iequals(it->path().stem().wstring(), p.filename().wstring()))
+            result.push_back(it->path().wstring());
+    }
+    return result;
+}
+
 std::wstring clean_path(std::wstring path) { return path; }
 
 std::wstring ensure_trailing_slash(std::wstring folder)
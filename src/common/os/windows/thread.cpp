@@ -33,4 +33,6 @@ inline void SetThreadName(DWORD dwThreadID, LPCSTR szThreadName)
 
 void set_thread_name(const std::wstring& name) { SetThreadName(GetCurrentThreadId(), u8(name).c_str()); }
 
+void set_thread_low_priority() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST); }
+
 } // namespace caspar
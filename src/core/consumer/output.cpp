@@ -27,64 +27,349 @@
 #include "../video_format.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/except.h>
+#include <common/future.h>
 #include <common/memory.h>
+#include <common/os/thread.h>
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <tbb/concurrent_queue.h>
+
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <thread>
 
 namespace caspar { namespace core {
 
 using time_point_t = decltype(std::chrono::high_resolution_clock::now());
 
+namespace {
+
+queue_options read_queue_options(const boost::property_tree::wptree& element, queue_options options)
+{
+    auto policy = element.get(L"queue-policy", L"");
+    if (boost::iequals(policy, L"block")) {
+        options.policy = queue_policy::block;
+    } else if (boost::iequals(policy, L"drop-oldest")) {
+        options.policy = queue_policy::drop_oldest;
+    } else if (boost::iequals(policy, L"drop-newest")) {
+        options.policy = queue_policy::drop_newest;
+    } else if (!policy.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid queue-policy: " + policy));
+    }
+
+    options.depth = element.get(L"queue-depth", options.depth);
+    if (options.depth < 1) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid queue-depth: " + std::to_wstring(options.depth)));
+    }
+
+    return options;
+}
+
+std::string print_policy(queue_policy policy)
+{
+    switch (policy) {
+        case queue_policy::drop_oldest:
+            return "drop-oldest";
+        case queue_policy::drop_newest:
+            return "drop-newest";
+        default:
+            return "block";
+    }
+}
+
+} // namespace
+
+queue_options get_queue_options()
+{
+    auto output = env::properties().get_child_optional(L"configuration.output");
+    return output ? read_queue_options(*output, queue_options{}) : queue_options{};
+}
+
+queue_options get_queue_options(const boost::property_tree::wptree& element)
+{
+    return read_queue_options(element, get_queue_options());
+}
+
+// A consumer together with the queue and thread that deliver frames to it. Consumers that provide the
+// synchronization clock bypass the queue and are sent to directly from the channel thread.
+class port
+{
+    struct item
+    {
+        const_frame  frame;
+        time_point_t time;
+    };
+
+    const spl::shared_ptr<frame_consumer> consumer_;
+    const queue_options                   options_;
+    const bool                            synchronous_;
+
+    tbb::concurrent_bounded_queue<item> queue_;
+    std::mutex                          consumer_mutex_;
+    std::atomic<bool>                   closed_{false};
+    std::atomic<bool>                   failed_{false};
+    std::atomic<int64_t>                delivered_{0};
+    std::atomic<int64_t>                dropped_{0};
+    std::atomic<int64_t>                latency_{0}; // microseconds
+    std::thread                         thread_;
+
+  public:
+    port(spl::shared_ptr<frame_consumer> consumer, const queue_options& options, int channel_index, int index)
+        : consumer_(std::move(consumer))
+        , options_(options)
+        , synchronous_(consumer_->has_synchronization_clock())
+    {
+        if (synchronous_) {
+            return;
+        }
+
+        queue_.set_capacity(options_.depth);
+
+        thread_ = std::thread([=] {
+            set_thread_name(L"output-" + std::to_wstring(channel_index) + L"-" + std::to_wstring(index));
+
+            while (true) {
+                item next;
+                queue_.pop(next);
+
+                // An empty frame is pushed by close().
+                if (!next.frame) {
+                    return;
+                }
+
+                // A failed consumer keeps draining so that a blocking channel never waits on it.
+                if (failed_) {
+                    continue;
+                }
+
+                try {
+                    std::lock_guard<std::mutex> lock(consumer_mutex_);
+                    if (consumer_->send(next.frame).get()) {
+                        delivered(next.time);
+                    } else {
+                        failed_ = true;
+                    }
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    failed_ = true;
+                }
+            }
+        });
+    }
+
+    ~port()
+    {
+        close();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    port(const port&) = delete;
+    port& operator=(const port&) = delete;
+
+    void initialize(const video_format_desc& format_desc, int channel_index)
+    {
+        item dropped;
+        while (queue_.try_pop(dropped)) {
+        }
+
+        std::lock_guard<std::mutex> lock(consumer_mutex_);
+        consumer_->initialize(format_desc, channel_index);
+    }
+
+    // Returns the future of the consumer itself when synchronous, otherwise whether the consumer is still alive.
+    std::future<bool> send(const const_frame& frame)
+    {
+        if (synchronous_) {
+            return consumer_->send(frame);
+        }
+
+        if (failed_ || closed_) {
+            return make_ready_future(false);
+        }
+
+        item next{frame, std::chrono::high_resolution_clock::now()};
+
+        switch (options_.policy) {
+            case queue_policy::block:
+                queue_.push(std::move(next));
+                break;
+            case queue_policy::drop_newest:
+                if (!queue_.try_push(std::move(next))) {
+                    dropped_ += 1;
+                }
+                break;
+            case queue_policy::drop_oldest:
+                while (!queue_.try_push(next)) {
+                    item oldest;
+                    if (queue_.try_pop(oldest)) {
+                        dropped_ += 1;
+                    }
+                }
+                break;
+        }
+
+        return make_ready_future(true);
+    }
+
+    void delivered(time_point_t time)
+    {
+        auto latency = std::chrono::high_resolution_clock::now() - time;
+        latency_     = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+        delivered_ += 1;
+    }
+
+    void close()
+    {
+        if (synchronous_ || closed_.exchange(true)) {
+            return;
+        }
+
+        // Make room for the end marker, even if the channel thread is blocked on a full queue.
+        item dropped;
+        while (!queue_.try_push(item{})) {
+            queue_.try_pop(dropped);
+        }
+    }
+
+    int64_t dropped() const { return dropped_; }
+
+    const spl::shared_ptr<frame_consumer>& consumer() const { return consumer_; }
+
+    monitor::state state() const
+    {
+        monitor::state state = consumer_->state();
+        if (synchronous_) {
+            state["queue"]["policy"] = std::string("synchronous");
+        } else {
+            state["queue"]["policy"] = print_policy(options_.policy);
+            state["queue"]["depth"]  = options_.depth;
+            state["queue"]["size"]   = static_cast<int>(std::max<std::ptrdiff_t>(queue_.size(), 0));
+        }
+        state["queue"]["dropped"]   = dropped_.load();
+        state["queue"]["delivered"] = delivered_.load();
+        state["queue"]["latency"]   = static_cast<double>(latency_.load()) / 1000.0;
+        return state;
+    }
+};
+
 struct output::impl
 {
-    monitor::state                      state_;
     spl::shared_ptr<diagnostics::graph> graph_;
     const int                           channel_index_;
     video_format_desc                   format_desc_;
+    const queue_options                 default_options_ = get_queue_options();
 
-    std::mutex                                     consumers_mutex_;
-    std::map<int, spl::shared_ptr<frame_consumer>> consumers_;
+    std::mutex                           consumers_mutex_;
+    std::map<int, std::shared_ptr<port>> consumers_;
 
     boost::optional<time_point_t> time_;
 
+    // A port joins its delivery thread when destroyed, which waits for a slow or hung consumer. The last reference is
+    // often dropped on the channel thread, so ports are destroyed on threads of their own, which the output waits for
+    // when it is destroyed itself.
+    std::mutex              retired_mutex_;
+    std::condition_variable retired_cond_;
+    int                     retired_ = 0;
+
   public:
     impl(spl::shared_ptr<diagnostics::graph> graph, const video_format_desc& format_desc, int channel_index)
         : graph_(std::move(graph))
         , channel_index_(channel_index)
         , format_desc_(format_desc)
     {
+        graph_->set_color("consumer-dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
     }
 
-    void add(int index, spl::shared_ptr<frame_consumer> consumer)
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            consumers_.clear();
+        }
+
+        std::unique_lock<std::mutex> lock(retired_mutex_);
+        retired_cond_.wait(lock, [&] { return retired_ == 0; });
+    }
+
+    std::shared_ptr<port> make_port(spl::shared_ptr<frame_consumer> consumer, const queue_options& options, int index)
+    {
+        return std::shared_ptr<port>(new port(std::move(consumer), options, channel_index_, index), [this](port* p) {
+            {
+                std::lock_guard<std::mutex> lock(retired_mutex_);
+                retired_ += 1;
+            }
+
+            std::thread([this, p] {
+                try {
+                    delete p;
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+
+                std::lock_guard<std::mutex> lock(retired_mutex_);
+                retired_ -= 1;
+                retired_cond_.notify_all();
+            })
+                .detach();
+        });
+    }
+
+    void add(int index, spl::shared_ptr<frame_consumer> consumer, const queue_options& options)
     {
         remove(index);
 
         consumer->initialize(format_desc_, channel_index_);
 
+        auto p = make_port(std::move(consumer), options, index);
+
         std::lock_guard<std::mutex> lock(consumers_mutex_);
-        consumers_.emplace(index, std::move(consumer));
+        consumers_.emplace(index, std::move(p));
     }
 
+    void add(int index, spl::shared_ptr<frame_consumer> consumer) { add(index, consumer, default_options_); }
+
     void add(const spl::shared_ptr<frame_consumer>& consumer) { add(consumer->index(), consumer); }
 
     bool remove(int index)
     {
-        std::lock_guard<std::mutex> lock(consumers_mutex_);
-        auto                        it = consumers_.find(index);
-        if (it != consumers_.end()) {
+        std::shared_ptr<port> p;
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            auto                        it = consumers_.find(index);
+            if (it == consumers_.end()) {
+                return false;
+            }
+            p = std::move(it->second);
             consumers_.erase(it);
-            return true;
         }
-        return false;
+        p->close();
+        return true;
     }
 
     bool remove(const spl::shared_ptr<frame_consumer>& consumer) { return remove(consumer->index()); }
 
+    void remove(int index, const std::shared_ptr<port>& p)
+    {
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            auto                        it = consumers_.find(index);
+            if (it != consumers_.end() && it->second == p) {
+                consumers_.erase(it);
+            }
+        }
+        p->close();
+    }
+
     void operator()(const_frame input_frame, const core::video_format_desc& format_desc)
     {
         if (!input_frame) {
@@ -98,15 +383,19 @@ struct output::impl
 
         auto time = std::move(time_);
 
-        if (format_desc_ != format_desc) {
+        decltype(consumers_) consumers;
+        {
             std::lock_guard<std::mutex> lock(consumers_mutex_);
-            for (auto it = consumers_.begin(); it != consumers_.end();) {
+            consumers = consumers_;
+        }
+
+        if (format_desc_ != format_desc) {
+            for (auto& p : consumers) {
                 try {
-                    it->second->initialize(format_desc, it->first);
-                    ++it;
+                    p.second->initialize(format_desc, channel_index_);
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
-                    it = consumers_.erase(it);
+                    remove(p.first, p.second);
                 }
             }
             format_desc_ = format_desc;
@@ -114,43 +403,43 @@ struct output::impl
             return;
         }
 
-        decltype(consumers_) consumers;
-        {
-            std::lock_guard<std::mutex> lock(consumers_mutex_);
-            consumers = consumers_;
-        }
-
         std::map<int, std::future<bool>> futures;
 
-        for (auto it = consumers_.begin(); it != consumers_.end();) {
+        auto send_time = std::chrono::high_resolution_clock::now();
+        for (auto it = consumers.begin(); it != consumers.end();) {
             try {
+                auto dropped = it->second->dropped();
                 futures.emplace(it->first, it->second->send(input_frame));
+                if (it->second->dropped() != dropped) {
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "consumer-dropped-frame");
+                }
                 ++it;
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
-                it = consumers_.erase(it);
+                remove(it->first, it->second);
+                it = consumers.erase(it);
             }
         }
 
-        for (auto& p : futures) {
+        for (auto& f : futures) {
+            auto& p = consumers.at(f.first);
             try {
-                if (!p.second.get()) {
-                    consumers_.erase(p.first);
+                if (!f.second.get()) {
+                    remove(f.first, p);
+                    consumers.erase(f.first);
+                } else if (p->consumer()->has_synchronization_clock()) {
+                    p->delivered(send_time);
                 }
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
-                consumers_.erase(p.first);
+                remove(f.first, p);
+                consumers.erase(f.first);
             }
         }
 
-        monitor::state state;
-        for (auto& p : consumers_) {
-            state["port"][p.first] = p.second->state();
-        }
-        state_ = std::move(state);
-
-        const auto needs_sync = std::all_of(
-            consumers_.begin(), consumers_.end(), [](auto& p) { return !p.second->has_synchronization_clock(); });
+        const auto needs_sync = std::all_of(consumers.begin(), consumers.end(), [](auto& p) {
+            return !p.second->consumer()->has_synchronization_clock();
+        });
 
         if (needs_sync) {
             if (!time) {
@@ -164,6 +453,21 @@ struct output::impl
         }
     }
 
+    monitor::state state()
+    {
+        decltype(consumers_) consumers;
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            consumers = consumers_;
+        }
+
+        monitor::state state;
+        for (auto& p : consumers) {
+            state["port"][p.first] = p.second->state();
+        }
+        return state;
+    }
+
     std::wstring print() const { return L"output[" + std::to_wstring(channel_index_) + L"]"; }
 };
 
@@ -173,6 +477,10 @@ output::output(spl::shared_ptr<diagnostics::graph> graph, const video_format_des
 }
 output::~output() {}
 void output::add(int index, const spl::shared_ptr<frame_consumer>& consumer) { impl_->add(index, consumer); }
+void output::add(int index, const spl::shared_ptr<frame_consumer>& consumer, const queue_options& options)
+{
+    impl_->add(index, consumer, options);
+}
 void output::add(const spl::shared_ptr<frame_consumer>& consumer) { impl_->add(consumer); }
 bool output::remove(int index) { return impl_->remove(index); }
 bool output::remove(const spl::shared_ptr<frame_consumer>& consumer) { return impl_->remove(consumer); }
@@ -180,5 +488,5 @@ void output::operator()(const_frame frame, const video_format_desc& format_desc)
 {
     return (*impl_)(std::move(frame), format_desc);
 }
-core::monitor::state output::state() const { return impl_->state_; }
+core::monitor::state output::state() const { return impl_->state(); }
 }} // namespace caspar::core
@@ -27,12 +27,33 @@
 #include <common/forward.h>
 #include <common/memory.h>
 
+#include <boost/property_tree/ptree_fwd.hpp>
+
 #include <memory>
 
 FORWARD2(caspar, diagnostics, class graph);
 
 namespace caspar { namespace core {
 
+// What happens to a frame when the queue of a consumer is full. Consumers that provide the synchronization clock are
+// always fed synchronously from the channel thread.
+enum class queue_policy
+{
+    block,
+    drop_oldest,
+    drop_newest
+};
+
+struct queue_options
+{
+    queue_policy policy = queue_policy::block;
+    int          depth  = 2;
+};
+
+// Reads queue-policy and queue-depth, either from the consumer element or from configuration.output.
+queue_options get_queue_options();
+queue_options get_queue_options(const boost::property_tree::wptree& element);
+
 class output final
 {
   public:
@@ -46,6 +67,7 @@ class output final
 
     void add(const spl::shared_ptr<frame_consumer>& consumer);
     void add(int index, const spl::shared_ptr<frame_consumer>& consumer);
+    void add(int index, const spl::shared_ptr<frame_consumer>& consumer, const queue_options& options);
     bool remove(const spl::shared_ptr<frame_consumer>& consumer);
     bool remove(int index);
 
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "animation.h"
+
+#include <common/except.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <algorithm>
+
+namespace caspar { namespace core {
+
+namespace {
+
+// Longest animation accepted, one hour at 60 fps.
+const int max_duration = 60 * 60 * 60;
+
+double& property_value(frame_transform& transform, animation_property property)
+{
+    auto& image = transform.image_transform;
+
+    switch (property) {
+        case animation_property::opacity:
+            return image.opacity;
+        case animation_property::contrast:
+            return image.contrast;
+        case animation_property::brightness:
+            return image.brightness;
+        case animation_property::saturation:
+            return image.saturation;
+        case animation_property::anchor_x:
+            return image.anchor[0];
+        case animation_property::anchor_y:
+            return image.anchor[1];
+        case animation_property::fill_x:
+            return image.fill_translation[0];
+        case animation_property::fill_y:
+            return image.fill_translation[1];
+        case animation_property::fill_scale_x:
+            return image.fill_scale[0];
+        case animation_property::fill_scale_y:
+            return image.fill_scale[1];
+        case animation_property::clip_x:
+            return image.clip_translation[0];
+        case animation_property::clip_y:
+            return image.clip_translation[1];
+        case animation_property::clip_scale_x:
+            return image.clip_scale[0];
+        case animation_property::clip_scale_y:
+            return image.clip_scale[1];
+        case animation_property::angle:
+            return image.angle;
+        case animation_property::volume:
+            return transform.audio_transform.volume;
+    }
+
+    CASPAR_THROW_EXCEPTION(programming_error() << msg_info(L"Unhandled animation property"));
+}
+
+} // namespace
+
+boost::optional<animation_property> get_animation_property(const std::wstring& name)
+{
+    static const std::vector<std::pair<std::wstring, animation_property>> names = {
+        {L"OPACITY", animation_property::opacity},
+        {L"CONTRAST", animation_property::contrast},
+        {L"BRIGHTNESS", animation_property::brightness},
+        {L"SATURATION", animation_property::saturation},
+        {L"ANCHOR_X", animation_property::anchor_x},
+        {L"ANCHOR_Y", animation_property::anchor_y},
+        {L"FILL_X", animation_property::fill_x},
+        {L"FILL_Y", animation_property::fill_y},
+        {L"FILL_SCALE_X", animation_property::fill_scale_x},
+        {L"FILL_SCALE_Y", animation_property::fill_scale_y},
+        {L"CLIP_X", animation_property::clip_x},
+        {L"CLIP_Y", animation_property::clip_y},
+        {L"CLIP_SCALE_X", animation_property::clip_scale_x},
+        {L"CLIP_SCALE_Y", animation_property::clip_scale_y},
+        {L"ROTATION", animation_property::angle},
+        {L"VOLUME", animation_property::volume},
+    };
+
+    for (auto& p : names) {
+        if (boost::iequals(p.first, name)) {
+            return p.second;
+        }
+    }
+    return boost::none;
+}
+
+animation::animation(const std::vector<animation_track>& tracks, bool loop)
+    : loop_(loop)
+{
+    for (auto& track : tracks) {
+        auto& keyframes = track.second;
+
+        if (keyframes.empty()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Animation track without keyframes"));
+        }
+
+        for (size_t n = 0; n < keyframes.size(); ++n) {
+            if (keyframes[n].frame < 0 || keyframes[n].frame >= max_duration ||
+                (n > 0 && keyframes[n].frame <= keyframes[n - 1].frame)) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Keyframes must be in increasing frame order"));
+            }
+        }
+
+        properties_.push_back(track.first);
+        duration_ = std::max(duration_, keyframes.back().frame + 1);
+    }
+
+    const auto count = properties_.size();
+
+    samples_.resize(count * duration_);
+
+    for (size_t i = 0; i < count; ++i) {
+        auto& keyframes = tracks[i].second;
+
+        size_t next = 0;
+        for (int frame = 0; frame < duration_; ++frame) {
+            while (next < keyframes.size() && keyframes[next].frame <= frame) {
+                ++next;
+            }
+
+            double value;
+            if (next == 0) {
+                value = keyframes.front().value;
+            } else if (next == keyframes.size()) {
+                value = keyframes.back().value;
+            } else {
+                auto& from = keyframes[next - 1];
+                auto& to   = keyframes[next];
+                value      = to.tween(frame - from.frame, from.value, to.value - from.value, to.frame - from.frame);
+            }
+
+            samples_[frame * count + i] = value;
+        }
+    }
+}
+
+void animation::apply(int frame, frame_transform& transform) const
+{
+    if (duration_ == 0) {
+        return;
+    }
+
+    frame = loop_ ? frame % duration_ : std::min(frame, duration_ - 1);
+
+    const auto count  = properties_.size();
+    const auto sample = samples_.data() + frame * count;
+    for (size_t i = 0; i < count; ++i) {
+        property_value(transform, properties_[i]) = sample[i];
+    }
+}
+
+}} // namespace caspar::core
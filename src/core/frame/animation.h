@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "frame_transform.h"
+
+#include <common/tweener.h>
+
+#include <boost/optional.hpp>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace core {
+
+enum class animation_property
+{
+    opacity,
+    contrast,
+    brightness,
+    saturation,
+    anchor_x,
+    anchor_y,
+    fill_x,
+    fill_y,
+    fill_scale_x,
+    fill_scale_y,
+    clip_x,
+    clip_y,
+    clip_scale_x,
+    clip_scale_y,
+    angle,
+    volume,
+};
+
+boost::optional<animation_property> get_animation_property(const std::wstring& name);
+
+struct keyframe
+{
+    int     frame = 0; // frames from the start of the animation
+    double  value = 0.0;
+    tweener tween; // from the previous keyframe to this one
+};
+
+using animation_track = std::pair<animation_property, std::vector<keyframe>>;
+
+/**
+ * Keyframe tracks for a number of transform properties, played back one frame
+ * per channel tick on top of the tweened transform of a layer.
+ *
+ * The tracks are sampled for every frame when the animation is created, so
+ * playing it back only reads a row of a flat array. Before its first keyframe
+ * and after its last a track holds the value of that keyframe.
+ */
+class animation final
+{
+  public:
+    animation(const std::vector<animation_track>& tracks, bool loop);
+
+    int  duration() const { return duration_; }
+    bool loop() const { return loop_; }
+
+    void apply(int frame, frame_transform& transform) const;
+
+  private:
+    std::vector<animation_property> properties_;
+    std::vector<double>             samples_; // properties_.size() values per frame
+    int                             duration_ = 0;
+    bool                            loop_     = false;
+};
+
+}} // namespace caspar::core
@@ -40,7 +40,9 @@ FORWARD2(caspar, core, class video_channel);
 FORWARD2(caspar, core, struct pixel_format_desc);
 FORWARD2(caspar, core, class cg_producer_registry);
 FORWARD2(caspar, core, struct frame_transform);
+FORWARD2(caspar, core, class animation);
 FORWARD2(caspar, core, struct write_frame_consumer);
 FORWARD2(caspar, core, struct frame_producer_dependencies);
 FORWARD2(caspar, core, struct module_dependencies);
 FORWARD2(caspar, core, class frame_producer_registry);
+FORWARD2(caspar, core, class media_scanner);
@@ -32,7 +32,12 @@
 #include <boost/container/flat_map.hpp>
 #include <boost/range/algorithm.hpp>
 
+#include <smmintrin.h>
+
+#include <algorithm>
 #include <atomic>
+#include <cstdlib>
+#include <limits>
 #include <stack>
 #include <vector>
 
@@ -46,7 +51,148 @@ struct audio_item
     array<const int32_t> samples;
 };
 
-using audio_buffer_ps = std::vector<double>;
+namespace {
+
+// Absolute value saturated to int32 max, so that int32 min counts as clipping rather than as a negative peak.
+__m128i abs_sat_epi32(__m128i x) { return _mm_min_epu32(_mm_abs_epi32(x), _mm_set1_epi32(0x7FFFFFFF)); }
+
+int32_t abs_sat(int32_t x)
+{
+    return x == std::numeric_limits<int32_t>::min() ? std::numeric_limits<int32_t>::max() : std::abs(x);
+}
+
+// Per channel peak tracking for interleaved samples. When the channel count is a multiple of four every vector of
+// four samples maps to the same four channels each time around, so the peaks can be kept in vectors.
+class peak_meter
+{
+    static const int max_lanes = 16;
+
+    std::vector<int32_t>& peaks_;
+    const int             channels_;
+    const int             lanes_;
+    int                   lane_ = 0;
+    __m128i               vector_peaks_[max_lanes];
+
+  public:
+    peak_meter(std::vector<int32_t>& peaks, int channels)
+        : peaks_(peaks)
+        , channels_(channels)
+        , lanes_(channels % 4 == 0 && channels / 4 <= max_lanes ? channels / 4 : 0)
+    {
+        for (int n = 0; n < lanes_; ++n) {
+            vector_peaks_[n] = _mm_setzero_si128();
+        }
+    }
+
+    ~peak_meter()
+    {
+        for (int n = 0; n < lanes_; ++n) {
+            int32_t values[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(values), vector_peaks_[n]);
+            for (int ch = 0; ch < 4; ++ch) {
+                peaks_[n * 4 + ch] = std::max(peaks_[n * 4 + ch], values[ch]);
+            }
+        }
+    }
+
+    bool vectorized() const { return lanes_ > 0; }
+
+    void operator()(__m128i samples)
+    {
+        vector_peaks_[lane_] = _mm_max_epi32(vector_peaks_[lane_], abs_sat_epi32(samples));
+        if (++lane_ == lanes_) {
+            lane_ = 0;
+        }
+    }
+
+    void operator()(std::size_t index, int32_t sample)
+    {
+        auto& peak = peaks_[index % channels_];
+        peak       = std::max(peak, abs_sat(sample));
+    }
+};
+
+// Adds samples * volume to dest. Items shorter than the mix are padded with their last sample frame, which is
+// scaled once per channel and then added over the remainder.
+void accumulate(float* dest, const array<const int32_t>& samples, std::size_t size, int channels, float volume)
+{
+    auto src   = samples.data();
+    auto count = std::min(samples.size(), size);
+    auto vol   = _mm_set1_ps(volume);
+
+    std::size_t n = 0;
+    for (; n + 8 <= count; n += 8) {
+        auto a = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n)));
+        auto b = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n + 4)));
+        _mm_storeu_ps(dest + n, _mm_add_ps(_mm_loadu_ps(dest + n), _mm_mul_ps(a, vol)));
+        _mm_storeu_ps(dest + n + 4, _mm_add_ps(_mm_loadu_ps(dest + n + 4), _mm_mul_ps(b, vol)));
+    }
+    for (; n < count; ++n) {
+        dest[n] += static_cast<float>(src[n]) * volume;
+    }
+
+    if (count == size || count < static_cast<std::size_t>(channels)) {
+        return;
+    }
+
+    auto last = std::vector<float>(channels);
+    for (int ch = 0; ch < channels; ++ch) {
+        last[ch] = static_cast<float>(src[count - channels + ch]) * volume;
+    }
+    for (auto ch = static_cast<int>(count % channels); n < size; ++n) {
+        dest[n] += last[ch];
+        if (++ch == channels) {
+            ch = 0;
+        }
+    }
+}
+
+// Fused master volume, clamp, conversion to int32 and peak metering.
+void convert(int32_t* dest, const float* src, std::size_t size, float volume, peak_meter& meter)
+{
+    // cvttps yields 0x80000000 for out of range values, which is already right for negative overflow. Positive
+    // overflow is flipped to 0x7FFFFFFF through the comparison mask.
+    const auto vol   = _mm_set1_ps(volume);
+    const auto limit = _mm_set1_ps(2147483648.0f);
+
+    std::size_t n = 0;
+    if (meter.vectorized()) {
+        for (; n + 4 <= size; n += 4) {
+            auto x = _mm_mul_ps(_mm_loadu_ps(src + n), vol);
+            auto y = _mm_xor_si128(_mm_cvttps_epi32(x), _mm_castps_si128(_mm_cmpge_ps(x, limit)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), y);
+            meter(y);
+        }
+    }
+
+    for (; n < size; ++n) {
+        auto x = static_cast<double>(src[n]) * volume;
+        if (x >= 2147483648.0) {
+            dest[n] = std::numeric_limits<int32_t>::max();
+        } else if (x < -2147483648.0) {
+            dest[n] = std::numeric_limits<int32_t>::min();
+        } else {
+            dest[n] = static_cast<int32_t>(x);
+        }
+        meter(n, dest[n]);
+    }
+}
+
+void measure(const int32_t* src, std::size_t size, peak_meter& meter)
+{
+    std::size_t n = 0;
+    if (meter.vectorized()) {
+        for (; n + 4 <= size; n += 4) {
+            meter(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n)));
+        }
+    }
+
+    for (; n < size; ++n) {
+        meter(n, src[n]);
+    }
+}
+
+} // namespace
 
 struct audio_mixer::impl
 {
@@ -92,54 +238,47 @@ struct audio_mixer::impl
 
     array<const int32_t> mix(const video_format_desc& format_desc, int nb_samples)
     {
-        auto channels = format_desc.audio_channels;
-        auto items    = std::move(items_);
-        auto result   = std::vector<int32_t>(nb_samples * channels, 0);
-
-        auto mixed = std::vector<double>(nb_samples * channels, 0.0f);
-
-        for (auto& item : items) {
-            auto ptr  = item.samples.data();
-            auto size = result.size();
-            for (auto n = 0; n < size; ++n) {
-                if (n < item.samples.size()) {
-                    mixed[n] = static_cast<double>(ptr[n]) * item.transform.volume + mixed[n];
-                } else {
-                    auto offset = (item.samples.size()) - (channels - (n % channels));
-                    mixed[n]    = static_cast<double>(ptr[offset]) * item.transform.volume + mixed[n];
-                }
-            }
-        }
-
+        auto channels      = format_desc.audio_channels;
+        auto items         = std::move(items_);
+        auto size          = static_cast<std::size_t>(nb_samples) * channels;
         auto master_volume = master_volume_.load();
-        for (auto n = 0; n < mixed.size(); ++n) {
-            auto sample = mixed[n] * master_volume;
-            if (sample > std::numeric_limits<int32_t>::max()) {
-                result[n] = std::numeric_limits<int32_t>::max();
-            } else if (sample < std::numeric_limits<int32_t>::min()) {
-                result[n] = std::numeric_limits<int32_t>::min();
-            } else {
-                result[n] = static_cast<int32_t>(sample);
+        auto peaks         = std::vector<int32_t>(channels, 0);
+
+        array<const int32_t> result;
+
+        if (items.size() == 1 && items[0].transform.volume == 1.0 && master_volume == 1.0f &&
+            items[0].samples.size() == size) {
+            // A single unity gain item is passed through as is.
+            result = std::move(items[0].samples);
+
+            peak_meter meter(peaks, channels);
+            measure(result.data(), size, meter);
+        } else {
+            auto mixed = std::vector<float>(size, 0.0f);
+
+            for (auto& item : items) {
+                accumulate(mixed.data(), item.samples, size, channels, static_cast<float>(item.transform.volume));
             }
-        }
 
-        auto max = std::vector<int32_t>(channels, std::numeric_limits<int32_t>::min());
-        for (size_t n = 0; n < result.size(); n += channels) {
-            for (int ch = 0; ch < channels; ++ch) {
-                max[ch] = std::max(max[ch], std::abs(result[n + ch]));
+            auto output = std::vector<int32_t>(size);
+            {
+                peak_meter meter(peaks, channels);
+                convert(output.data(), mixed.data(), size, master_volume, meter);
             }
+            result = array<int32_t>(std::move(output));
         }
 
-        if (boost::range::count_if(max, [](auto val) { return val >= std::numeric_limits<int32_t>::max(); }) > 0) {
+        auto max = *boost::max_element(peaks);
+
+        if (max >= std::numeric_limits<int32_t>::max()) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "audio-clipping");
         }
 
-        state_["volume"] = std::move(max);
+        graph_->set_value("volume", static_cast<double>(max) / std::numeric_limits<int32_t>::max());
 
-        graph_->set_value("volume",
-                          static_cast<double>(*boost::max_element(max)) / std::numeric_limits<int32_t>::max());
+        state_["volume"] = std::move(peaks);
 
-        return std::move(result);
+        return result;
     }
 };
 
@@ -42,7 +42,6 @@ namespace caspar { namespace core {
 
 struct mixer::impl
 {
-    monitor::state                       state_;
     int                                  channel_index_;
     spl::shared_ptr<diagnostics::graph>  graph_;
     audio_mixer                          audio_mixer_{graph_};
@@ -70,8 +69,6 @@ struct mixer::impl
         auto image = (*image_mixer_)(format_desc);
         auto audio = audio_mixer_(format_desc, nb_samples);
 
-        state_["audio"] = audio_mixer_.state();
-
         buffer_.push(std::async(
             std::launch::deferred,
             [image = std::move(image), audio = std::move(audio), graph = graph_, format_desc, tag = this]() mutable {
@@ -94,6 +91,13 @@ struct mixer::impl
     void set_master_volume(float volume) { audio_mixer_.set_master_volume(volume); }
 
     float get_master_volume() { return audio_mixer_.get_master_volume(); }
+
+    monitor::state state() const
+    {
+        monitor::state state;
+        state["audio"] = audio_mixer_.state();
+        return state;
+    }
 };
 
 mixer::mixer(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::shared_ptr<image_mixer> image_mixer)
@@ -110,5 +114,5 @@ mutable_frame mixer::create_frame(const void* tag, const pixel_format_desc& desc
 {
     return impl_->image_mixer_->create_frame(tag, desc);
 }
-core::monitor::state mixer::state() const { return impl_->state_; }
+core::monitor::state mixer::state() const { return impl_->state(); }
 }} // namespace caspar::core
@@ -26,6 +26,7 @@
 #include "consumer/frame_consumer.h"
 #include "producer/cg_proxy.h"
 #include "producer/frame_producer.h"
+#include "producer/media_info/media_scanner.h"
 #include "protocol/amcp/amcp_command_repository.h"
 
 namespace caspar { namespace core {
@@ -35,15 +36,18 @@ struct module_dependencies
     const spl::shared_ptr<cg_producer_registry>                    cg_registry;
     const spl::shared_ptr<frame_producer_registry>                 producer_registry;
     const spl::shared_ptr<frame_consumer_registry>                 consumer_registry;
+    const spl::shared_ptr<core::media_scanner>                     media_scanner;
     const std::shared_ptr<protocol::amcp::amcp_command_repository> command_repository;
 
     module_dependencies(spl::shared_ptr<cg_producer_registry>                    cg_registry,
                         spl::shared_ptr<frame_producer_registry>                 producer_registry,
                         spl::shared_ptr<frame_consumer_registry>                 consumer_registry,
+                        spl::shared_ptr<core::media_scanner>                     media_scanner,
                         std::shared_ptr<protocol::amcp::amcp_command_repository> command_repository)
         : cg_registry(std::move(cg_registry))
         , producer_registry(std::move(producer_registry))
         , consumer_registry(std::move(consumer_registry))
+        , media_scanner(std::move(media_scanner))
         , command_repository(std::move(command_repository))
     {
     }
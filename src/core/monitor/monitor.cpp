@@ -0,0 +1,131 @@
+/*
+ * Copyright 2013 Sveriges Television AB http://casparcg.com/
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "monitor.h"
+
+#include <tbb/concurrent_unordered_map.h>
+#include <tbb/concurrent_vector.h>
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace caspar { namespace core { namespace monitor {
+
+namespace {
+
+template <typename K>
+struct key_hash
+{
+    std::size_t operator()(const std::pair<path_t, K>& key) const
+    {
+        return std::hash<K>()(key.second) * 31 + key.first;
+    }
+};
+
+// Lookups are lock free, only the first use of a key takes the lock. Every full path name maps to exactly one id,
+// however it was reached, so that e.g. joining a child state gives the same id as indexing down to it.
+class registry
+{
+    std::mutex                              mutex_;
+    tbb::concurrent_vector<std::string>     names_;
+    std::unordered_map<std::string, path_t> paths_by_name_;
+
+    tbb::concurrent_unordered_map<std::pair<path_t, std::string>, path_t, key_hash<std::string>> names_by_key_;
+    tbb::concurrent_unordered_map<std::pair<path_t, std::int64_t>, path_t, key_hash<std::int64_t>> indices_by_key_;
+    tbb::concurrent_unordered_map<std::pair<path_t, path_t>, path_t, key_hash<path_t>>             joins_by_key_;
+
+    template <typename M, typename K>
+    path_t find_or_add(M& map, const K& key, const std::function<std::string()>& name)
+    {
+        auto it = map.find(key);
+        if (it != map.end()) {
+            return it->second;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        it = map.find(key);
+        if (it != map.end()) {
+            return it->second;
+        }
+
+        auto full_name = name();
+        auto path      = paths_by_name_.find(full_name);
+        if (path == paths_by_name_.end()) {
+            auto id = static_cast<path_t>(names_.push_back(full_name) - names_.begin());
+            path    = paths_by_name_.emplace(std::move(full_name), id).first;
+        }
+
+        map.insert(std::make_pair(key, path->second));
+        return path->second;
+    }
+
+    std::string child_name(path_t parent, const std::string& name) const
+    {
+        return parent == 0 ? name : names_[parent] + "/" + name;
+    }
+
+  public:
+    // The root is not in paths_by_name_, so that an empty first segment (as in state[""]["channel"]) gets its own
+    // id and children of it are named "/channel".
+    registry() { names_.push_back(""); }
+
+    path_t intern(path_t parent, const std::string& name)
+    {
+        return find_or_add(names_by_key_, std::make_pair(parent, name), [&] { return child_name(parent, name); });
+    }
+
+    path_t intern(path_t parent, std::int64_t index)
+    {
+        return find_or_add(
+            indices_by_key_, std::make_pair(parent, index), [&] { return child_name(parent, std::to_string(index)); });
+    }
+
+    path_t join(path_t parent, path_t child)
+    {
+        if (parent == 0) {
+            return child;
+        }
+        if (child == 0) {
+            return parent;
+        }
+        return find_or_add(
+            joins_by_key_, std::make_pair(parent, child), [&] { return child_name(parent, names_[child]); });
+    }
+
+    const std::string& name(path_t path) const { return names_[path]; }
+};
+
+registry& get_registry()
+{
+    static registry instance;
+    return instance;
+}
+
+} // namespace
+
+path_t             intern(path_t parent, const std::string& name) { return get_registry().intern(parent, name); }
+path_t             intern(path_t parent, std::int64_t index) { return get_registry().intern(parent, index); }
+path_t             join(path_t parent, path_t child) { return get_registry().join(parent, child); }
+const std::string& path_name(path_t path) { return get_registry().name(path); }
+
+}}} // namespace caspar::core::monitor
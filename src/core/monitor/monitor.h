@@ -25,6 +25,8 @@
 
 #include <cstdint>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <boost/container/flat_map.hpp>
@@ -32,9 +34,45 @@
 
 namespace caspar { namespace core { namespace monitor {
 
+// Paths are interned once into integer ids, so that building a state does not concatenate strings. Id 0 is the
+// root. Interning is thread safe and ids stay valid for the lifetime of the process.
+using path_t = std::uint32_t;
+
+path_t             intern(path_t parent, const std::string& name);
+path_t             intern(path_t parent, std::int64_t index);
+path_t             join(path_t parent, path_t child);
+const std::string& path_name(path_t path);
+
+template <typename T>
+std::enable_if_t<std::is_integral<T>::value, path_t> intern_key(path_t parent, T key)
+{
+    return intern(parent, static_cast<std::int64_t>(key));
+}
+
+template <typename T>
+std::enable_if_t<!std::is_integral<T>::value && std::is_convertible<const T&, std::string>::value, path_t>
+intern_key(path_t parent, const T& key)
+{
+    return intern(parent, std::string(key));
+}
+
+template <typename T>
+std::enable_if_t<!std::is_integral<T>::value && !std::is_convertible<const T&, std::string>::value, path_t>
+intern_key(path_t parent, const T& key)
+{
+    return intern(parent, boost::lexical_cast<std::string>(key));
+}
+
+// Orders paths by name, so that a state iterates in the same order as when it was keyed by path names. Every name
+// has exactly one id, so equal ids are equal names and the names need not be compared.
+struct path_less
+{
+    bool operator()(path_t lhs, path_t rhs) const { return lhs != rhs && path_name(lhs) < path_name(rhs); }
+};
+
 using data_t     = boost::variant<bool, std::int32_t, std::int64_t, float, double, std::string, std::wstring>;
 using vector_t   = boost::container::small_vector<data_t, 2>;
-using data_map_t = boost::container::flat_map<std::string, vector_t>;
+using data_map_t = boost::container::flat_map<path_t, vector_t, path_less>;
 
 class state
 {
@@ -42,62 +80,105 @@ class state
 
     class state_proxy
     {
-        std::string key_;
+        path_t      path_;
         data_map_t& data_;
 
       public:
-        state_proxy(const std::string& key, data_map_t& data)
-            : key_(key)
+        state_proxy(path_t path, data_map_t& data)
+            : path_(path)
             , data_(data)
         {
         }
 
         state_proxy& operator=(data_t data)
         {
-            data_[key_] = {std::move(data)};
+            data_[path_] = {std::move(data)};
             return *this;
         }
 
         state_proxy& operator=(vector_t data)
         {
-            data_[key_] = std::move(data);
+            data_[path_] = std::move(data);
             return *this;
         }
 
         template <typename T>
         state_proxy operator[](const T& key)
         {
-            return state_proxy(key_ + "/" + boost::lexical_cast<std::string>(key), data_);
+            return state_proxy(intern_key(path_, key), data_);
         }
 
         template <typename T>
         state_proxy& operator=(const std::vector<T>& data)
         {
-            data_[key_] = vector_t(data.begin(), data.end());
+            data_[path_] = vector_t(data.begin(), data.end());
             return *this;
         }
 
         state_proxy& operator=(std::initializer_list<data_t> data)
         {
-            data_[key_] = vector_t(std::move(data));
+            data_[path_] = vector_t(std::move(data));
             return *this;
         }
 
         state_proxy& operator=(const state& other)
         {
-            for (auto& p : other) {
-                data_[key_ + "/" + p.first] = std::move(p.second);
+            for (auto& p : other.data_) {
+                data_[join(path_, p.first)] = p.second;
+            }
+            return *this;
+        }
+
+        state_proxy& operator=(state&& other)
+        {
+            for (auto& p : other.data_) {
+                data_[join(path_, p.first)] = std::move(p.second);
             }
             return *this;
         }
     };
 
   public:
+    class const_iterator
+    {
+        data_map_t::const_iterator it_;
+
+      public:
+        using value_type = std::pair<const std::string&, const vector_t&>;
+
+        struct pointer
+        {
+            value_type        value;
+            const value_type* operator->() const { return &value; }
+        };
+
+        explicit const_iterator(data_map_t::const_iterator it)
+            : it_(it)
+        {
+        }
+
+        value_type operator*() const { return value_type(path_name(it_->first), it_->second); }
+        pointer    operator->() const { return pointer{**this}; }
+
+        const_iterator& operator++()
+        {
+            ++it_;
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const { return it_ == other.it_; }
+        bool operator!=(const const_iterator& other) const { return it_ != other.it_; }
+    };
+
     state() = default;
     state(const state& other)
         : data_(other.data_)
     {
     }
+    state(state&& other)
+        : data_(std::move(other.data_))
+    {
+    }
     state(data_map_t data)
         : data_(std::move(data))
     {
@@ -107,16 +188,25 @@ class state
         data_ = other.data_;
         return *this;
     }
+    state& operator=(state&& other)
+    {
+        data_ = std::move(other.data_);
+        return *this;
+    }
 
     template <typename T>
     state_proxy operator[](const T& key)
     {
-        return state_proxy(boost::lexical_cast<std::string>(key), data_);
+        return state_proxy(intern_key(0, key), data_);
     }
 
-    data_map_t::const_iterator begin() const { return data_.begin(); }
+    void        reserve(std::size_t size) { data_.reserve(size); }
+    std::size_t size() const { return data_.size(); }
+    bool        empty() const { return data_.empty(); }
+
+    const_iterator begin() const { return const_iterator(data_.begin()); }
 
-    data_map_t::const_iterator end() const { return data_.end(); }
+    const_iterator end() const { return const_iterator(data_.end()); }
 };
 
 }}} // namespace caspar::core::monitor
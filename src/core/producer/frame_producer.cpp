@@ -24,6 +24,7 @@
 #include "cg_proxy.h"
 #include "frame_producer.h"
 
+#include "../diagnostics/call_context.h"
 #include "../frame/draw_frame.h"
 
 #include "color/color_producer.h"
@@ -31,17 +32,120 @@
 #include "separated/separated_producer.h"
 
 #include <common/assert.h>
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/except.h>
-#include <common/executor.h>
 #include <common/future.h>
 #include <common/memory.h>
+#include <common/os/filesystem.h>
+#include <common/os/thread.h>
+#include <common/timer.h>
 
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace caspar { namespace core {
+// Registered producer factories, indexed by the keywords, URL schemes and file extensions they declared.
+class producer_index
+{
+    using index_t = std::unordered_map<std::wstring, std::vector<std::size_t>>;
+
+    std::vector<producer_factory_t> factories_;
+    index_t                         keywords_;
+    index_t                         schemes_;
+    index_t                         extensions_;
+
+    static void insert(index_t& index, const std::set<std::wstring>& keys, std::size_t n)
+    {
+        for (auto& key : keys) {
+            index[boost::to_lower_copy(key)].push_back(n);
+        }
+    }
+
+    static void lookup(const index_t& index, const std::wstring& key, std::vector<std::size_t>& result)
+    {
+        auto it = index.find(boost::to_lower_copy(key));
+        if (it != index.end()) {
+            result.insert(result.end(), it->second.begin(), it->second.end());
+        }
+    }
+
+    // Extensions of the media files that params[0] may refer to by stem.
+    std::vector<std::wstring> resolve_extensions(const std::wstring& name) const
+    {
+        const auto path = boost::filesystem::path(env::media_folder() + name);
+        const auto ext  = path.extension().wstring();
+
+        if (!ext.empty() && extensions_.find(boost::to_lower_copy(ext)) != extensions_.end()) {
+            return {ext};
+        }
+
+        std::vector<std::wstring> result;
+        try {
+            for (auto& file : find_case_insensitive_stem(path.wstring())) {
+                result.push_back(boost::filesystem::path(file).extension().wstring());
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        return result;
+    }
+
+  public:
+    void add(const producer_factory_t& factory, const producer_factory_hints& hints)
+    {
+        const auto n = factories_.size();
+        factories_.push_back(factory);
+        insert(keywords_, hints.keywords, n);
+        insert(schemes_, hints.schemes, n);
+        insert(extensions_, hints.extensions, n);
+    }
+
+    // Factories whose hints match params, in registration order. Resolving the hints costs at most one directory
+    // listing, however many factories are registered.
+    std::vector<std::size_t> match(const std::vector<std::wstring>& params) const
+    {
+        std::vector<std::size_t> result;
+
+        const auto& name = params.at(0);
+        lookup(keywords_, name, result);
+
+        const auto scheme = name.find(L"://");
+        if (scheme != std::wstring::npos) {
+            lookup(schemes_, name.substr(0, scheme), result);
+            lookup(extensions_, boost::filesystem::path(name).extension().wstring(), result);
+        } else if (result.empty()) {
+            for (auto& ext : resolve_extensions(name)) {
+                lookup(extensions_, ext, result);
+            }
+        }
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    std::size_t size() const { return factories_.size(); }
+
+    const producer_factory_t& operator[](std::size_t n) const { return factories_[n]; }
+};
+
 struct frame_producer_registry::impl
 {
-    std::vector<producer_factory_t> producer_factories;
+    producer_index producer_factories;
 };
 
 frame_producer_registry::frame_producer_registry()
@@ -49,9 +153,11 @@ frame_producer_registry::frame_producer_registry()
 {
 }
 
-void frame_producer_registry::register_producer_factory(std::wstring name, const producer_factory_t& factory)
+void frame_producer_registry::register_producer_factory(std::wstring                  name,
+                                                        const producer_factory_t&     factory,
+                                                        const producer_factory_hints& hints)
 {
-    impl_->producer_factories.push_back(factory);
+    impl_->producer_factories.add(factory, hints);
 }
 
 frame_producer_dependencies::frame_producer_dependencies(
@@ -93,13 +199,128 @@ const spl::shared_ptr<frame_producer>& frame_producer::empty()
     return producer;
 }
 
-std::shared_ptr<executor>& producer_destroyer()
+// Destroys producers on a few worker threads, since some take seconds to die (thread joins, CEF shutdown). Handing
+// a producer over never blocks; instead create_producer() waits briefly while too many are still waiting to be
+// destroyed. The limit counts producers rather than the memory they hold, which is not known for most of them.
+class producer_destroyer
 {
-    static auto destroyer = [] {
-        auto result = std::make_shared<executor>(L"Producer destroyer");
-        result->set_capacity(std::numeric_limits<unsigned int>::max());
-        return result;
-    }();
+    const int    max_pending_ = std::max(1, env::properties().get(L"configuration.producer-teardown.max-pending", 32));
+    const double max_wait_    = std::max(0.0, env::properties().get(L"configuration.producer-teardown.max-wait", 0.1));
+
+    // Producers taking longer than this to destroy are logged and tagged.
+    const double slow_teardown_ = 1.0;
+
+    spl::shared_ptr<caspar::diagnostics::graph>                    graph_;
+    tbb::concurrent_bounded_queue<std::shared_ptr<frame_producer>> queue_;
+    std::atomic<int>                                               pending_{0};
+    std::atomic<int64_t>                                           destroyed_{0};
+    std::mutex                                                     mutex_;
+    std::condition_variable                                        cond_;
+    std::vector<std::thread>                                       threads_;
+
+  public:
+    producer_destroyer()
+    {
+        graph_->set_color("pending", caspar::diagnostics::color(0.2f, 0.9f, 0.9f));
+        graph_->set_color("teardown-time", caspar::diagnostics::color(1.0f, 0.4f, 0.0f, 0.8f));
+        graph_->set_color("slow-teardown", caspar::diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_text(print());
+        caspar::diagnostics::register_graph(graph_);
+
+        auto count = std::max(1, env::properties().get(L"configuration.producer-teardown.threads", 2));
+        for (int n = 0; n < count; ++n) {
+            threads_.emplace_back([=] {
+                set_thread_name(L"producer-destroyer-" + std::to_wstring(n));
+                run();
+            });
+        }
+    }
+
+    ~producer_destroyer()
+    {
+        // Workers finish whatever is queued before they see an end marker.
+        for (size_t n = 0; n < threads_.size(); ++n) {
+            queue_.push(nullptr);
+        }
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void destroy(std::shared_ptr<frame_producer> producer)
+    {
+        pending_ += 1;
+        graph_->set_value("pending", static_cast<double>(pending_) / max_pending_);
+        queue_.push(std::move(producer));
+    }
+
+    // Called on the thread loading the new producer, which for LOAD is the AMCP thread, so the wait stays short and
+    // loading goes ahead after it.
+    void wait_for_capacity()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!cond_.wait_for(lock, std::chrono::duration<double>(max_wait_), [&] { return pending_ < max_pending_; })) {
+            CASPAR_LOG(warning) << print() << L" " << pending_ << L" producers still waiting to be destroyed.";
+        }
+    }
+
+    std::wstring print() const
+    {
+        return L"producer-destroyer[" + std::to_wstring(pending_) + L" pending|" + std::to_wstring(destroyed_) +
+               L" destroyed]";
+    }
+
+  private:
+    void run()
+    {
+        while (true) {
+            std::shared_ptr<frame_producer> producer;
+            queue_.pop(producer);
+            if (!producer) {
+                return;
+            }
+
+            auto str = producer->print();
+            try {
+                if (producer.use_count() > 1)
+                    CASPAR_LOG(debug) << str << L" Not destroyed on asynchronous destruction thread: "
+                                      << producer.use_count();
+                else
+                    CASPAR_LOG(debug) << str << L" Destroying on asynchronous destruction thread.";
+            } catch (...) {
+            }
+
+            caspar::timer teardown_timer;
+            try {
+                producer.reset();
+                CASPAR_LOG(info) << str << L" Destroyed.";
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            auto elapsed = teardown_timer.elapsed();
+            graph_->set_value("teardown-time", elapsed / slow_teardown_ * 0.5);
+            if (elapsed > slow_teardown_) {
+                graph_->set_tag(caspar::diagnostics::tag_severity::WARNING, "slow-teardown");
+                CASPAR_LOG(warning) << str << L" took " << elapsed << L"s to destroy.";
+            }
+
+            destroyed_ += 1;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_ -= 1;
+            }
+            cond_.notify_all();
+
+            graph_->set_value("pending", static_cast<double>(pending_) / max_pending_);
+            graph_->set_text(print());
+        }
+    }
+};
+
+std::shared_ptr<producer_destroyer>& get_producer_destroyer()
+{
+    static auto destroyer = std::make_shared<producer_destroyer>();
 
     return destroyer;
 }
@@ -115,7 +336,7 @@ void destroy_producers_synchronously()
 {
     destroy_producers_in_separate_thread() = false;
     // Join destroyer, executing rest of producers in queue synchronously.
-    producer_destroyer().reset();
+    get_producer_destroyer().reset();
 }
 
 class destroy_producer_proxy : public frame_producer
@@ -134,34 +355,12 @@ class destroy_producer_proxy : public frame_producer
         if (producer_ == core::frame_producer::empty() || !destroy_producers_in_separate_thread())
             return;
 
-        auto destroyer = producer_destroyer();
+        auto destroyer = get_producer_destroyer();
 
         if (!destroyer)
             return;
 
-        CASPAR_VERIFY(destroyer->size() < 8);
-
-        auto producer = new spl::shared_ptr<frame_producer>(std::move(producer_));
-
-        destroyer->begin_invoke([=] {
-            std::unique_ptr<spl::shared_ptr<frame_producer>> pointer_guard(producer);
-            auto                                             str = (*producer)->print();
-            try {
-                if (!producer->unique())
-                    CASPAR_LOG(debug) << str << L" Not destroyed on asynchronous destruction thread: "
-                                      << producer->use_count();
-                else
-                    CASPAR_LOG(debug) << str << L" Destroying on asynchronous destruction thread.";
-            } catch (...) {
-            }
-
-            try {
-                pointer_guard.reset();
-                CASPAR_LOG(info) << str << L" Destroyed.";
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-            }
-        });
+        destroyer->destroy(std::move(producer_));
     }
 
     draw_frame                receive_impl(int nb_samples) override { return producer_->receive(nb_samples); }
@@ -184,10 +383,10 @@ spl::shared_ptr<core::frame_producer> create_destroy_proxy(spl::shared_ptr<core:
     return spl::make_shared<destroy_producer_proxy>(std::move(producer));
 }
 
-spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_dependencies&     dependencies,
-                                                         const std::vector<std::wstring>&       params,
-                                                         const std::vector<producer_factory_t>& factories,
-                                                         bool                                   throw_on_fail = false)
+spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_dependencies& dependencies,
+                                                         const std::vector<std::wstring>&   params,
+                                                         const producer_index&              factories,
+                                                         bool                               probe_all)
 {
     if (params.empty()) {
         CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("params cannot be empty"));
@@ -203,41 +402,58 @@ spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_de
         return producer;
     }
 
-    if (std::any_of(factories.begin(), factories.end(), [&](const producer_factory_t& factory) -> bool {
-            try {
-                producer = factory(dependencies, params);
-            } catch (user_error&) {
-                throw;
-            } catch (...) {
-                if (throw_on_fail)
-                    throw;
-                else
-                    CASPAR_LOG_CURRENT_EXCEPTION();
-            }
-            return producer != frame_producer::empty();
-        })) {
+    auto try_factory = [&](std::size_t n) -> bool {
+        try {
+            producer = factories[n](dependencies, params);
+        } catch (user_error&) {
+            throw;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        return producer != frame_producer::empty();
+    };
+
+    const auto matches = factories.match(params);
+    if (std::any_of(matches.begin(), matches.end(), try_factory)) {
         return producer;
     }
+
+    if (!probe_all) {
+        return frame_producer::empty();
+    }
+
+    // Nothing declared these params, fall back to asking the remaining factories in turn.
+    for (std::size_t n = 0; n < factories.size(); ++n) {
+        if (!std::binary_search(matches.begin(), matches.end(), n) && try_factory(n)) {
+            return producer;
+        }
+    }
     return frame_producer::empty();
 }
 
-spl::shared_ptr<core::frame_producer>
-frame_producer_registry::create_producer(const frame_producer_dependencies& dependencies,
-                                         const std::vector<std::wstring>&   params) const
+spl::shared_ptr<core::frame_producer> create_producer(const frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&   params,
+                                                      const producer_index&              producer_factories)
 {
-    auto& producer_factories = impl_->producer_factories;
-    auto  producer           = do_create_producer(dependencies, params, producer_factories);
-    auto  key_producer       = frame_producer::empty();
+    // Back pressure on producer creation rather than on the stage, which must never wait for a teardown.
+    auto destroyer = get_producer_destroyer();
+    if (destroyer) {
+        destroyer->wait_for_capacity();
+    }
+
+    auto producer     = do_create_producer(dependencies, params, producer_factories, true);
+    auto key_producer = frame_producer::empty();
 
     if (!params.empty() && !boost::contains(params.at(0), L"://")) {
         try // to find a key file.
         {
             auto params_copy = params;
+            // Key files are media files, so only factories that declared what they handle are asked.
             params_copy[0] += L"_A";
-            key_producer = do_create_producer(dependencies, params_copy, producer_factories);
+            key_producer = do_create_producer(dependencies, params_copy, producer_factories, false);
             if (key_producer == frame_producer::empty()) {
                 params_copy[0] += L"LPHA";
-                key_producer = do_create_producer(dependencies, params_copy, producer_factories);
+                key_producer = do_create_producer(dependencies, params_copy, producer_factories, false);
             }
         } catch (...) {
         }
@@ -257,6 +473,243 @@ frame_producer_registry::create_producer(const frame_producer_dependencies& depe
     return producer;
 }
 
+// Constructs producers for create_producer_async(), so that opening a stream or probing a large file does not hold
+// up the caller.
+class producer_constructor
+{
+    tbb::concurrent_bounded_queue<std::function<void()>> queue_;
+    std::vector<std::thread>                             threads_;
+
+  public:
+    producer_constructor()
+    {
+        auto count = std::max(1, env::properties().get(L"configuration.producer-construction.threads", 4));
+        for (int n = 0; n < count; ++n) {
+            threads_.emplace_back([=] {
+                set_thread_name(L"producer-constructor-" + std::to_wstring(n));
+
+                while (true) {
+                    std::function<void()> task;
+                    queue_.pop(task);
+                    if (!task) {
+                        return;
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~producer_constructor()
+    {
+        for (size_t n = 0; n < threads_.size(); ++n) {
+            queue_.push(nullptr);
+        }
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void post(std::function<void()> task) { queue_.push(std::move(task)); }
+};
+
+std::shared_ptr<producer_constructor>& get_producer_constructor()
+{
+    static auto constructor = std::make_shared<producer_constructor>();
+
+    return constructor;
+}
+
+void stop_producer_construction()
+{
+    // Join constructors, finishing the producers already queued. Later ones are constructed on the caller's thread.
+    get_producer_constructor().reset();
+}
+
+class pending_producer_proxy : public frame_producer
+{
+    const uint64_t     id_;
+    const std::wstring params_;
+
+    mutable std::mutex                                  mutex_;
+    std::shared_future<spl::shared_ptr<frame_producer>> future_;
+    std::shared_ptr<frame_producer>                     producer_;
+    std::shared_ptr<frame_producer>                     leading_producer_;
+
+    std::shared_ptr<frame_producer> get() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return producer_;
+    }
+
+    // The real producer once it is ready, nullptr until then.
+    std::shared_ptr<frame_producer> poll()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!producer_ && future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            try {
+                producer_ = future_.get();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(error) << L"pending[" << id_ << L"|" << params_ << L"] Failed to load.";
+                producer_ = frame_producer::empty();
+            }
+            future_ = {};
+
+            if (leading_producer_) {
+                producer_->leading_producer(spl::make_shared_ptr(leading_producer_));
+                leading_producer_.reset();
+            }
+        }
+        return producer_;
+    }
+
+  public:
+    pending_producer_proxy(uint64_t                                            id,
+                           std::wstring                                        params,
+                           std::shared_future<spl::shared_ptr<frame_producer>> future)
+        : id_(id)
+        , params_(std::move(params))
+        , future_(std::move(future))
+    {
+    }
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        auto producer = poll();
+        return producer ? producer->receive(nb_samples) : draw_frame{};
+    }
+
+    draw_frame last_frame() override
+    {
+        auto producer = poll();
+        return producer ? producer->last_frame() : draw_frame{};
+    }
+
+    draw_frame first_frame() override
+    {
+        auto producer = poll();
+        return producer ? producer->first_frame() : draw_frame{};
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        auto producer = poll();
+        if (!producer) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(print() + L" Producer is still loading."));
+        }
+        return producer->call(params);
+    }
+
+    void leading_producer(const spl::shared_ptr<frame_producer>& producer) override
+    {
+        auto ready = poll();
+        if (ready) {
+            ready->leading_producer(producer);
+        } else {
+            std::lock_guard<std::mutex> lock(mutex_);
+            leading_producer_ = producer;
+        }
+    }
+
+    spl::shared_ptr<frame_producer> following_producer() const override
+    {
+        auto producer = get();
+        return producer ? producer->following_producer() : frame_producer::empty();
+    }
+
+    boost::optional<int64_t> auto_play_delta() const override
+    {
+        auto producer = get();
+        return producer ? producer->auto_play_delta() : boost::none;
+    }
+
+    uint32_t frame_number() const override
+    {
+        auto producer = get();
+        return producer ? producer->frame_number() : 0;
+    }
+
+    uint32_t nb_frames() const override
+    {
+        auto producer = get();
+        return producer ? producer->nb_frames() : std::numeric_limits<uint32_t>::max();
+    }
+
+    core::monitor::state state() const override
+    {
+        auto producer = get();
+        if (producer) {
+            return producer->state();
+        }
+
+        core::monitor::state state;
+        state["pending"] = static_cast<int64_t>(id_);
+        return state;
+    }
+
+    std::wstring print() const override
+    {
+        auto producer = get();
+        return producer ? producer->print() : L"pending[" + std::to_wstring(id_) + L"|" + params_ + L"]";
+    }
+
+    std::wstring name() const override
+    {
+        auto producer = get();
+        return producer ? producer->name() : L"pending";
+    }
+};
+
+spl::shared_ptr<core::frame_producer>
+frame_producer_registry::create_producer(const frame_producer_dependencies& dependencies,
+                                         const std::vector<std::wstring>&   params) const
+{
+    return core::create_producer(dependencies, params, impl_->producer_factories);
+}
+
+pending_producer frame_producer_registry::create_producer_async(const frame_producer_dependencies& dependencies,
+                                                                const std::vector<std::wstring>&   params) const
+{
+    static std::atomic<uint64_t> next_id{0};
+
+    auto producer_promise = std::make_shared<std::promise<spl::shared_ptr<frame_producer>>>();
+    auto ready_promise    = std::make_shared<std::promise<void>>();
+    auto call_context     = diagnostics::call_context::for_thread();
+    auto impl             = impl_;
+
+    auto task = [=] {
+        diagnostics::scoped_call_context save;
+        diagnostics::call_context::for_thread() = call_context;
+
+        try {
+            producer_promise->set_value(core::create_producer(dependencies, params, impl->producer_factories));
+            ready_promise->set_value();
+        } catch (...) {
+            producer_promise->set_exception(std::current_exception());
+            ready_promise->set_exception(std::current_exception());
+        }
+    };
+
+    auto constructor = get_producer_constructor();
+    if (constructor) {
+        constructor->post(task);
+    } else {
+        task();
+    }
+
+    std::wstring str;
+    for (auto& param : params)
+        str += (str.empty() ? L"" : L" ") + param;
+
+    pending_producer result;
+    result.id       = ++next_id;
+    result.producer = spl::make_shared<pending_producer_proxy>(result.id, str, producer_promise->get_future().share());
+    result.ready    = ready_promise->get_future().share();
+    return result;
+}
+
 spl::shared_ptr<core::frame_producer>
 frame_producer_registry::create_producer(const frame_producer_dependencies& dependencies,
                                          const std::wstring&                params) const
@@ -35,6 +35,7 @@
 #include <cstdint>
 #include <functional>
 #include <future>
+#include <set>
 #include <string>
 #include <type_traits>
 #include <vector>
@@ -136,15 +137,41 @@ struct frame_producer_dependencies
 using producer_factory_t = std::function<spl::shared_ptr<core::frame_producer>(const frame_producer_dependencies&,
                                                                                const std::vector<std::wstring>&)>;
 
+// What a producer factory handles, so that the registry can dispatch to it without asking every factory in turn.
+// Keywords match the first parameter (e.g. DECKLINK), schemes the part of a URL before :// and extensions the
+// resolved media file. Factories without hints are only asked when no hinted factory produced anything.
+struct producer_factory_hints
+{
+    std::set<std::wstring> keywords;
+    std::set<std::wstring> schemes;
+    std::set<std::wstring> extensions;
+};
+
+// A producer being constructed on a worker thread.
+struct pending_producer
+{
+    uint64_t id = 0;
+
+    // Placeholder that plays nothing until the producer is ready, and plays nothing at all should it fail.
+    spl::shared_ptr<frame_producer> producer = frame_producer::empty();
+
+    // Ready once the producer has been constructed, holding the exception if its construction failed.
+    std::shared_future<void> ready;
+};
+
 class frame_producer_registry
 {
   public:
     frame_producer_registry();
-    void register_producer_factory(std::wstring name, const producer_factory_t& factoryr); // Not thread-safe.
+    void register_producer_factory(std::wstring                  name,
+                                   const producer_factory_t&     factory,
+                                   const producer_factory_hints& hints = {}); // Not thread-safe.
     spl::shared_ptr<core::frame_producer> create_producer(const frame_producer_dependencies&,
                                                           const std::vector<std::wstring>& params) const;
     spl::shared_ptr<core::frame_producer> create_producer(const frame_producer_dependencies&,
                                                           const std::wstring& params) const;
+    pending_producer                      create_producer_async(const frame_producer_dependencies&,
+                                                                const std::vector<std::wstring>& params) const;
 
   private:
     struct impl;
@@ -156,5 +183,6 @@ class frame_producer_registry
 
 spl::shared_ptr<core::frame_producer> create_destroy_proxy(spl::shared_ptr<core::frame_producer> producer);
 void                                  destroy_producers_synchronously();
+void                                  stop_producer_construction();
 
 }} // namespace caspar::core
@@ -32,7 +32,7 @@ namespace caspar { namespace core {
 
 struct layer::impl
 {
-    monitor::state state_;
+    int64_t frames_left_ = 0;
 
     spl::shared_ptr<frame_producer> foreground_ = frame_producer::empty();
     spl::shared_ptr<frame_producer> background_ = frame_producer::empty();
@@ -108,17 +108,7 @@ struct layer::impl
                 frame = foreground_->last_frame();
             }
 
-            state_                           = {};
-            state_["foreground"]             = foreground_->state();
-            state_["foreground"]["producer"] = foreground_->name();
-            state_["foreground"]["paused"]   = paused_;
-
-            if (frames_left > 0) {
-                state_["foreground"]["frames_left"] = frames_left;
-            }
-
-            state_["background"]             = background_->state();
-            state_["background"]["producer"] = background_->name();
+            frames_left_ = frames_left;
 
             return frame;
         } catch (...) {
@@ -128,6 +118,23 @@ struct layer::impl
         }
     }
 
+    // Built on request only, the stage asks for it when someone is monitoring the channel.
+    monitor::state state() const
+    {
+        monitor::state state;
+        state["foreground"]             = foreground_->state();
+        state["foreground"]["producer"] = foreground_->name();
+        state["foreground"]["paused"]   = paused_;
+
+        if (frames_left_ > 0) {
+            state["foreground"]["frames_left"] = frames_left_;
+        }
+
+        state["background"]             = background_->state();
+        state["background"]["producer"] = background_->name();
+        return state;
+    }
+
     draw_frame receive_background(const video_format_desc& format_desc, int nb_samples)
     {
         try {
@@ -174,5 +181,5 @@ draw_frame layer::receive_background(const video_format_desc& format_desc, int n
 spl::shared_ptr<frame_producer> layer::foreground() const { return impl_->foreground_; }
 spl::shared_ptr<frame_producer> layer::background() const { return impl_->background_; }
 bool                            layer::has_background() const { return impl_->background_ != frame_producer::empty(); }
-core::monitor::state            layer::state() const { return impl_->state_; }
+core::monitor::state            layer::state() const { return impl_->state(); }
 }} // namespace caspar::core
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/rational.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace caspar { namespace core {
+
+struct media_info
+{
+    std::wstring             clip_type; // MOVIE, STILL or AUDIO
+    std::int64_t             duration = 0; // in frames of time_base
+    boost::rational<int64_t> time_base; // duration of one frame in seconds, zero when there is no video
+    std::wstring             format; // container format
+    std::wstring             streams; // one short description per stream, comma separated
+};
+
+// Fills in info for the file at path, returning false if the file is not handled.
+using media_info_extractor = std::function<bool(const std::wstring& path, media_info& info)>;
+
+}} // namespace caspar::core
@@ -0,0 +1,524 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../StdAfx.h"
+
+#include "media_scanner.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/os/thread.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/concurrent_queue.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace caspar { namespace core {
+
+namespace {
+
+// Files are kept sorted by name, and by path among files of the same name.
+using file_key = std::pair<std::wstring, std::wstring>;
+
+struct entry
+{
+    media_file file;
+    bool       probed = false;
+};
+
+using listing = std::map<file_key, entry>;
+
+std::wstring name_of(const std::wstring& root, const std::wstring& path)
+{
+    auto relative = boost::filesystem::path(path.substr(root.size())).replace_extension().generic_wstring();
+    boost::replace_all(relative, L"\\", L"/");
+    boost::trim_left_if(relative, boost::is_any_of(L"/"));
+    return boost::to_upper_copy(relative);
+}
+
+bool stat(const std::wstring& root, const boost::filesystem::path& path, entry& e)
+{
+    boost::system::error_code ec;
+
+    e.file.path     = path.wstring();
+    e.file.name     = name_of(root, e.file.path);
+    e.file.size     = boost::filesystem::file_size(path, ec);
+    e.file.modified = ec ? 0 : boost::filesystem::last_write_time(path, ec);
+    return !ec;
+}
+
+// The files in root at or below path.
+listing list(const std::wstring& root, const std::wstring& path)
+{
+    listing result;
+
+    boost::system::error_code ec;
+    if (boost::filesystem::is_regular_file(path, ec)) {
+        entry e;
+        if (stat(root, path, e)) {
+            result.emplace(file_key(e.file.name, e.file.path), std::move(e));
+        }
+        return result;
+    }
+
+    for (auto it = boost::filesystem::recursive_directory_iterator(path, ec);
+         !ec && it != boost::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (!boost::filesystem::is_regular_file(it->status())) {
+            continue;
+        }
+
+        entry e;
+        if (stat(root, it->path(), e)) {
+            result.emplace(file_key(e.file.name, e.file.path), std::move(e));
+        }
+    }
+
+    return result;
+}
+
+std::vector<media_file> files_of(const listing& files, bool with_info_only)
+{
+    std::vector<media_file> result;
+    for (auto& p : files) {
+        if (!with_info_only || p.second.file.info) {
+            result.push_back(p.second.file);
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+struct media_scanner::impl
+{
+    struct folder
+    {
+        std::wstring root;
+        listing      files;
+        bool         watched = false;
+    };
+
+    const std::wstring              cache_path_;
+    const int                       nb_threads_;
+    const std::chrono::milliseconds interval_;
+
+    std::vector<media_info_extractor> extractors_;
+
+    mutable std::mutex mutex_;
+    folder             media_;
+    folder             templates_;
+    folder             fonts_;
+    std::set<file_key> queued_;
+    bool               dirty_ = false;
+
+    tbb::concurrent_bounded_queue<std::function<void()>> jobs_;
+    std::vector<std::thread>                             workers_;
+    std::thread                                          thread_;
+
+    std::atomic<bool>       abort_{false};
+    std::mutex              wait_mutex_;
+    std::condition_variable wait_cond_;
+    std::set<std::wstring>  changes_; // reported by the path index, applied on the scanner thread
+    bool                    probed_ = false;
+
+    impl()
+        : cache_path_(env::properties().get(L"configuration.media-scanner.cache-path",
+                                            env::data_folder() + L"media-info.cache"))
+        , nb_threads_(std::max(1, env::properties().get(L"configuration.media-scanner.threads", 2)))
+        , interval_(static_cast<int64_t>(
+              std::max(0.1, env::properties().get(L"configuration.media-scanner.interval", 5.0)) * 1000.0))
+    {
+        media_.root     = env::media_folder();
+        templates_.root = env::template_folder();
+        fonts_.root     = env::properties().get(L"configuration.paths.font-path", env::initial_folder() + L"/font/");
+    }
+
+    ~impl()
+    {
+        abort_ = true;
+        wait_cond_.notify_all();
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        jobs_.clear();
+        for (std::size_t n = 0; n < workers_.size(); ++n) {
+            jobs_.push(nullptr);
+        }
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void start()
+    {
+        load();
+
+        for (int n = 0; n < nb_threads_; ++n) {
+            workers_.emplace_back([this] {
+                set_thread_name(L"media-scanner");
+                while (true) {
+                    std::function<void()> job;
+                    jobs_.pop(job);
+                    if (!job) {
+                        break;
+                    }
+                    job();
+                }
+            });
+        }
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"media-scanner");
+            run();
+        });
+    }
+
+    // Folders are listed once, and are then kept current from the changes reported by the path index. Folders it
+    // can not watch, such as those on network filesystems, are listed again every interval.
+    void run()
+    {
+        for (auto f : {&media_, &templates_, &fonts_}) {
+            f->watched = watch_case_insensitive(f->root, [this](const std::wstring& path) {
+                {
+                    std::lock_guard<std::mutex> lock(wait_mutex_);
+                    changes_.insert(path);
+                }
+                wait_cond_.notify_all();
+            });
+        }
+
+        auto polled = std::chrono::steady_clock::now();
+        for (auto f : {&media_, &templates_, &fonts_}) {
+            update(*f, f->root);
+        }
+        queue_probes();
+
+        while (!abort_) {
+            std::set<std::wstring> changes;
+            {
+                std::unique_lock<std::mutex> lock(wait_mutex_);
+                wait_cond_.wait_until(lock, polled + interval_, [&] {
+                    return abort_ || !changes_.empty() || probed_;
+                });
+                changes.swap(changes_);
+                probed_ = false;
+            }
+
+            if (abort_) {
+                break;
+            }
+
+            try {
+                for (auto& path : changes) {
+                    for (auto f : {&media_, &templates_, &fonts_}) {
+                        if (contains(f->root, path)) {
+                            update(*f, path);
+                        }
+                    }
+                }
+
+                if (std::chrono::steady_clock::now() >= polled + interval_) {
+                    polled = std::chrono::steady_clock::now();
+                    for (auto f : {&media_, &templates_, &fonts_}) {
+                        if (!f->watched) {
+                            update(*f, f->root);
+                        }
+                    }
+                }
+
+                queue_probes();
+                save_if_dirty();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    static bool contains(const std::wstring& root, const std::wstring& path)
+    {
+        auto dir = boost::filesystem::path(root).generic_wstring();
+        boost::trim_right_if(dir, boost::is_any_of(L"/"));
+        return path == dir || boost::starts_with(path, dir + L"/");
+    }
+
+    // Replaces what is known about path, or about everything below it, with what is on the disk now. What was probed
+    // is kept for files that have not changed since.
+    void update(folder& f, const std::wstring& path)
+    {
+        auto files = list(f.root, path);
+
+        auto prefix = boost::filesystem::path(path).generic_wstring();
+        boost::trim_right_if(prefix, boost::is_any_of(L"/"));
+        prefix += L"/";
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        listing previous;
+        for (auto it = f.files.begin(); it != f.files.end();) {
+            const auto& file_path = it->second.file.path;
+            if (file_path == path || boost::starts_with(boost::filesystem::path(file_path).generic_wstring(), prefix)) {
+                previous.insert(std::move(*it));
+                it = f.files.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        for (auto& p : files) {
+            auto it = previous.find(p.first);
+            if (it != previous.end() && it->second.probed && it->second.file.size == p.second.file.size &&
+                it->second.file.modified == p.second.file.modified) {
+                p.second = it->second;
+            }
+        }
+
+        // Files that are gone are dropped from the saved media info as well.
+        for (auto& p : previous) {
+            dirty_ |= &f == &media_ && files.find(p.first) == files.end();
+        }
+
+        f.files.insert(std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+    }
+
+    void queue_probes()
+    {
+        std::vector<file_key> unprobed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& p : media_.files) {
+                if (!p.second.probed && queued_.insert(p.first).second) {
+                    unprobed.push_back(p.first);
+                }
+            }
+        }
+
+        for (auto& key : unprobed) {
+            jobs_.push([this, key] { probe(key); });
+        }
+    }
+
+    void save_if_dirty()
+    {
+        listing snapshot;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!dirty_ || !queued_.empty()) {
+                return;
+            }
+            snapshot = media_.files;
+            dirty_   = false;
+        }
+        save(snapshot);
+    }
+
+    void probe(const file_key& key)
+    {
+        // The scanner queues files that changed while they were probed again, and saves once all are probed.
+        CASPAR_SCOPE_EXIT
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queued_.erase(key);
+            }
+            {
+                std::lock_guard<std::mutex> lock(wait_mutex_);
+                probed_ = true;
+            }
+            wait_cond_.notify_all();
+        };
+
+        media_file file;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = media_.files.find(key);
+            if (it == media_.files.end() || it->second.probed) {
+                return;
+            }
+            file = it->second.file;
+        }
+
+        boost::optional<media_info> result;
+        for (auto& extractor : extractors_) {
+            if (abort_) {
+                return;
+            }
+
+            try {
+                media_info info;
+                if (extractor(file.path, info)) {
+                    result = std::move(info);
+                    break;
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = media_.files.find(key);
+        if (it != media_.files.end() && it->second.file.size == file.size &&
+            it->second.file.modified == file.modified) {
+            it->second.file.info = std::move(result);
+            it->second.probed    = true;
+            dirty_               = true;
+        }
+    }
+
+    // One tab separated line per probed file: path, size, modification time, clip type, duration, time base
+    // numerator and denominator, format and streams. Files that no extractor handled have an empty clip type.
+    void save(const listing& media) const
+    {
+        auto          tmp_path = cache_path_ + L".tmp";
+        std::ofstream file(u8(tmp_path), std::ios::binary | std::ios::trunc);
+
+        for (auto& p : media) {
+            auto& e = p.second;
+            if (!e.probed) {
+                continue;
+            }
+
+            auto info = e.file.info.get_value_or(media_info());
+            file << u8(e.file.path) << '\t' << e.file.size << '\t' << e.file.modified << '\t' << u8(info.clip_type)
+                 << '\t' << info.duration << '\t' << info.time_base.numerator() << '\t'
+                 << info.time_base.denominator() << '\t' << u8(info.format) << '\t' << u8(info.streams) << '\n';
+        }
+
+        file.close();
+
+        boost::system::error_code ec;
+        boost::filesystem::rename(tmp_path, cache_path_, ec);
+        if (ec) {
+            CASPAR_LOG(warning) << L"[media-scanner] Failed to save " << cache_path_ << L": " << u16(ec.message());
+        }
+    }
+
+    void load()
+    {
+        std::ifstream file(u8(cache_path_), std::ios::binary);
+        if (!file) {
+            return;
+        }
+
+        const auto root = env::media_folder();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::string line;
+        while (std::getline(file, line)) {
+            std::vector<std::string> fields;
+            boost::split(fields, line, boost::is_any_of("\t"));
+            if (fields.size() != 9) {
+                continue;
+            }
+
+            try {
+                entry e;
+                e.file.path = u16(fields[0]);
+                if (!boost::starts_with(e.file.path, root)) {
+                    continue;
+                }
+                e.file.name     = name_of(root, e.file.path);
+                e.file.size     = std::stoull(fields[1]);
+                e.file.modified = static_cast<std::time_t>(std::stoll(fields[2]));
+                e.probed        = true;
+
+                if (!fields[3].empty()) {
+                    media_info info;
+                    info.clip_type = u16(fields[3]);
+                    info.duration  = std::stoll(fields[4]);
+                    info.time_base = boost::rational<int64_t>(std::stoll(fields[5]), std::stoll(fields[6]));
+                    info.format    = u16(fields[7]);
+                    info.streams   = u16(fields[8]);
+                    e.file.info    = std::move(info);
+                }
+
+                media_.files.emplace(file_key(e.file.name, e.file.path), std::move(e));
+            } catch (...) {
+                // Skip malformed lines, the file will be probed again.
+            }
+        }
+
+        CASPAR_LOG(info) << L"[media-scanner] Loaded " << media_.files.size() << L" files from " << cache_path_ << L".";
+    }
+};
+
+media_scanner::media_scanner()
+    : impl_(new impl())
+{
+}
+
+void media_scanner::register_extractor(media_info_extractor extractor)
+{
+    impl_->extractors_.push_back(std::move(extractor));
+}
+
+void media_scanner::start() { impl_->start(); }
+
+std::vector<media_file> media_scanner::media() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return files_of(impl_->media_.files, true);
+}
+
+boost::optional<media_file> media_scanner::find_media(const std::wstring& name) const
+{
+    auto upper_name = boost::to_upper_copy(name);
+
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    for (auto it = impl_->media_.files.lower_bound(file_key(upper_name, L""));
+         it != impl_->media_.files.end() && it->first.first == upper_name;
+         ++it) {
+        if (it->second.file.info) {
+            return it->second.file;
+        }
+    }
+    return boost::none;
+}
+
+std::vector<media_file> media_scanner::templates() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return files_of(impl_->templates_.files, false);
+}
+
+std::vector<media_file> media_scanner::fonts() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return files_of(impl_->fonts_.files, false);
+}
+
+}} // namespace caspar::core
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "media_info.h"
+
+#include <common/memory.h>
+
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+struct media_file
+{
+    std::wstring                name; // relative to its folder, without extension, upper case and / separated
+    std::wstring                path;
+    std::uintmax_t              size     = 0;
+    std::time_t                 modified = 0;
+    boost::optional<media_info> info; // only media files are probed
+};
+
+/**
+ * Keeps listings of the media, template and font folders in memory, so that
+ * queries about them never touch the disk.
+ *
+ * The folders are walked once, and then kept current from the changes the
+ * path index reports, comparing size and modification time with what is
+ * already known. Folders that can not be watched, such as network shares,
+ * are walked periodically instead. New and changed media files are probed on
+ * a pool of worker threads by the registered extractors. What was probed is
+ * saved and loaded again on startup, so that only files changed since are
+ * probed anew.
+ */
+class media_scanner
+{
+  public:
+    media_scanner();
+
+    void register_extractor(media_info_extractor extractor); // Not thread-safe.
+    void start();
+
+    std::vector<media_file>     media() const; // files with media info, sorted by name
+    boost::optional<media_file> find_media(const std::wstring& name) const;
+    std::vector<media_file>     templates() const;
+    std::vector<media_file>     fonts() const;
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+
+    media_scanner(const media_scanner&) = delete;
+    media_scanner& operator=(const media_scanner&) = delete;
+};
+
+}} // namespace caspar::core
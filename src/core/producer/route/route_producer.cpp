@@ -21,6 +21,7 @@
 #include "route_producer.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/param.h>
 #include <common/timer.h>
 
@@ -29,12 +30,16 @@
 #include <core/producer/frame_producer.h>
 #include <core/video_channel.h>
 
+#include <boost/property_tree/ptree.hpp>
 #include <boost/range/algorithm/find_if.hpp>
 #include <boost/regex.hpp>
 #include <boost/signals2.hpp>
 
 #include <tbb/concurrent_queue.h>
 
+#include <algorithm>
+#include <chrono>
+
 namespace caspar { namespace core {
 
 class route_producer : public frame_producer
@@ -49,24 +54,40 @@ class route_producer : public frame_producer
     std::shared_ptr<route>             route_;
     boost::signals2::scoped_connection connection_;
 
+    // Read the frame of the current tick of the source channel rather than the buffered frames it has consumed.
+    const bool                      sync_;
+    const std::chrono::microseconds sync_timeout_;
+    uint64_t                        sync_count_ = 0;
+
     core::draw_frame frame_;
 
+    static core::draw_frame ensure_frame(core::draw_frame frame)
+    {
+        if (!frame) {
+            // We got a frame, so ensure it is a real frame (otherwise the layer gets confused)
+            frame = core::draw_frame::push(frame);
+        }
+        return frame;
+    }
+
   public:
-    route_producer(std::shared_ptr<route> route, int buffer)
+    route_producer(std::shared_ptr<route> route, int buffer, bool sync, std::chrono::microseconds sync_timeout)
         : route_(route)
-        , connection_(route_->signal.connect([this](const core::draw_frame& frame) {
-            auto frame2 = frame;
-            if (!frame2) {
-                // We got a frame, so ensure it is a real frame (otherwise the layer gets confused)
-                frame2 = core::draw_frame::push(frame2);
-            }
-            if (!buffer_.try_push(frame2)) {
-                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-            }
-            graph_->set_value("produce-time", produce_timer_.elapsed() * route_->format_desc.fps * 0.5);
-            produce_timer_.restart();
-        }))
+        , sync_(sync)
+        , sync_timeout_(sync_timeout)
     {
+        if (sync_) {
+            route_->sync_readers += 1;
+        } else {
+            connection_ = route_->signal.connect([this](const core::draw_frame& frame) {
+                if (!buffer_.try_push(ensure_frame(frame))) {
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                }
+                graph_->set_value("produce-time", produce_timer_.elapsed() * route_->format_desc.fps * 0.5);
+                produce_timer_.restart();
+            });
+        }
+
         buffer_.set_capacity(buffer > 0 ? buffer : route->format_desc.field_count);
 
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
@@ -79,10 +100,21 @@ class route_producer : public frame_producer
         CASPAR_LOG(debug) << print() << L" Initialized";
     }
 
+    ~route_producer()
+    {
+        if (sync_) {
+            route_->sync_readers -= 1;
+        }
+    }
+
     draw_frame last_frame() override
     {
         if (!frame_) {
-            buffer_.try_pop(frame_);
+            if (sync_) {
+                frame_ = ensure_frame(route_->latest());
+            } else {
+                buffer_.try_pop(frame_);
+            }
         }
         return core::draw_frame::still(frame_);
     }
@@ -90,7 +122,14 @@ class route_producer : public frame_producer
     draw_frame receive_impl(int nb_samples) override
     {
         core::draw_frame frame;
-        if (!buffer_.try_pop(frame)) {
+        if (sync_) {
+            if (!route_->wait(sync_count_, frame, sync_timeout_)) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+            } else {
+                frame  = ensure_frame(frame);
+                frame_ = frame;
+            }
+        } else if (!buffer_.try_pop(frame)) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
         } else {
             frame_ = frame;
@@ -101,7 +140,7 @@ class route_producer : public frame_producer
         return frame;
     }
 
-    std::wstring print() const override { return L"route[" + route_->name + L"]"; }
+    std::wstring print() const override { return L"route[" + route_->name + (sync_ ? L"|sync" : L"") + L"]"; }
 
     std::wstring name() const override { return L"route"; }
 };
@@ -135,8 +174,22 @@ spl::shared_ptr<core::frame_producer> create_route_producer(const core::frame_pr
     }
 
     auto buffer = get_param(L"BUFFER", params, 0);
+    auto sync   = contains_param(L"SYNC", params);
+    auto route  = (*channel_it)->route(layer, mode);
+
+    // Wait at most one frame of the source channel, and no longer than the stage waits for the layer, after which the
+    // previous frame is repeated. Waiting past the layer deadline would only keep a stage worker busy.
+    auto sync_timeout   = 1.0 / route->format_desc.fps;
+    auto layer_deadline = env::properties().get(L"configuration.stage.layer-deadline", 0.5);
+    if (layer_deadline > 0.0) {
+        sync_timeout = std::min(sync_timeout, layer_deadline / dependencies.format_desc.fps);
+    }
 
-    return spl::make_shared<route_producer>((*channel_it)->route(layer, mode), buffer);
+    return spl::make_shared<route_producer>(
+        route,
+        buffer,
+        sync,
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::duration<double>(sync_timeout)));
 }
 
 }} // namespace caspar::core
@@ -25,38 +25,177 @@
 
 #include "layer.h"
 
+#include "../frame/animation.h"
 #include "../frame/draw_frame.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/executor.h>
 #include <common/future.h>
+#include <common/timer.h>
 
 #include <core/frame/frame_transform.h>
 
+#include <boost/container/flat_map.hpp>
+#include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
 #include <boost/range/adaptors.hpp>
 
+#include <tbb/concurrent_queue.h>
+#include <tbb/task_arena.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <functional>
 #include <future>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace caspar { namespace core {
 
+thread_local stage_schedule schedule;
+
+stage_schedule& stage_schedule::for_thread() { return schedule; }
+
+struct layer_result
+{
+    layer_frame                           frame;
+    std::shared_ptr<const monitor::state> state;
+    double                                produce_time = 0.0;
+};
+
+struct layer_animation
+{
+    std::shared_ptr<const core::animation> animation;
+    int                                    frame = -1;
+};
+
+using animations_t = boost::container::flat_map<int, layer_animation>;
+
+void swap_animations(animations_t& a, int a_index, animations_t& b, int b_index)
+{
+    auto a_it = a.find(a_index);
+    auto b_it = b.find(b_index);
+
+    auto a_animation = a_it != a.end() ? a_it->second : layer_animation{};
+    auto b_animation = b_it != b.end() ? b_it->second : layer_animation{};
+
+    a.erase(a_index);
+    b.erase(b_index);
+
+    if (b_animation.animation) {
+        a[a_index] = b_animation;
+    }
+    if (a_animation.animation) {
+        b[b_index] = a_animation;
+    }
+}
+
+using layer_states_t = std::map<int, std::shared_ptr<const monitor::state>>;
+
+// Only moves states that have been collected, so that no empty snapshots are published for the other layer.
+void swap_layer_states(layer_states_t& a, int a_index, layer_states_t& b, int b_index)
+{
+    auto a_it = a.find(a_index);
+    auto b_it = b.find(b_index);
+
+    auto a_state = a_it != a.end() ? a_it->second : nullptr;
+    auto b_state = b_it != b.end() ? b_it->second : nullptr;
+
+    a.erase(a_index);
+    b.erase(b_index);
+
+    if (b_state) {
+        a[a_index] = b_state;
+    }
+    if (a_state) {
+        b[b_index] = a_state;
+    }
+}
+
+// Moves the entry of from at from_index, if there is one, to to_index of to.
+template <typename Map>
+void move_entry(Map& from, int from_index, Map& to, int to_index)
+{
+    auto it = from.find(from_index);
+    if (it != from.end()) {
+        to[to_index] = std::move(it->second);
+        from.erase(it);
+    }
+}
+
+// Layers on their way from one stage to another in a swap, either one layer or all of them.
+struct layer_handoff
+{
+    boost::optional<int>             index;
+    std::map<int, layer>             layers;
+    std::map<int, layer_frame>       last_frames;
+    layer_states_t                   layer_states;
+    std::map<int, tweened_transform> tweens;
+    animations_t                     animations;
+};
+
 struct stage::impl : public std::enable_shared_from_this<impl>
 {
     int                                 channel_index_;
     spl::shared_ptr<diagnostics::graph> graph_;
-    monitor::state                      state_;
     std::map<int, layer>                layers_;
     std::map<int, tweened_transform>    tweens_;
 
-    executor executor_{L"stage " + std::to_wstring(channel_index_)};
+    animations_t                        animations_;
+
+    // Fraction of a frame a layer is given to produce before its previous frame is reused, 0 waits forever.
+    const double layer_deadline_ = env::properties().get(L"configuration.stage.layer-deadline", 0.5);
+
+    std::map<int, std::future<layer_result>>             pending_;
+    std::map<int, layer_frame>                           last_frames_;
+    std::map<int, std::shared_ptr<const monitor::state>> layer_states_;
+
+    // Layer states are only collected on the tick after state() has been called, and are published as a snapshot
+    // that state() assembles on the caller's thread.
+    mutable std::atomic<bool>                            state_requested_{false};
+    mutable std::mutex                                   state_mutex_;
+    std::map<int, std::shared_ptr<const monitor::state>> published_states_;
+
+    // Stage calls are posted to a mailbox and run by the tick, before the layers are produced, so that control
+    // traffic never runs between or ahead of frames. A call returns false if it cannot run yet, and is retried on
+    // the next tick. Calls that change another stage as well are handed on through its mailbox, see hand_over().
+    using call_t = std::function<bool()>;
+
+    // Fraction of a frame the tick spends on posted calls before leaving the rest for the next tick.
+    const double call_budget_ = env::properties().get(L"configuration.stage.command-budget", 0.2);
+
+    tbb::concurrent_queue<call_t> mailbox_;
+    std::deque<call_t>            backlog_;
+
+    // Calls scheduled for a frame, applied in one batch at the start of its tick regardless of the budget.
+    std::atomic<int64_t>                    frame_number_{0};
+    std::mutex                              timeline_mutex_;
+    std::map<int64_t, std::vector<call_t>> timeline_;
+
+    // Last frames of layers handed to another stage in a swap, repeated until the other stage's layers arrive.
+    std::map<int, layer_frame> held_frames_;
+
+    tbb::task_arena arena_;
+    executor        executor_{L"stage " + std::to_wstring(channel_index_)};
 
   public:
     impl(int channel_index, spl::shared_ptr<diagnostics::graph> graph)
         : channel_index_(channel_index)
         , graph_(std::move(graph))
     {
+        graph_->set_color("late-layer", diagnostics::color(0.6f, 0.3f, 0.9f));
+        graph_->set_color("late-command", diagnostics::color(0.9f, 0.6f, 0.3f));
+        graph_->set_color("command-backlog", diagnostics::color(0.9f, 0.9f, 0.3f));
+    }
+
+    ~impl()
+    {
+        executor_.invoke([=] { wait_layers(); });
     }
 
     std::map<int, layer_frame>
@@ -66,30 +205,103 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             std::map<int, layer_frame> frames;
 
             try {
+                const auto now = std::chrono::steady_clock::now();
+                const auto deadline =
+                    now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::duration<double>(layer_deadline_ / format_desc.fps));
+
+                apply_scheduled(++frame_number_);
+                apply_posted(now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                       std::chrono::duration<double>(call_budget_ / format_desc.fps)));
+
                 for (auto& t : tweens_)
                     t.second.tick(1);
 
+                for (auto& a : animations_)
+                    a.second.frame += 1;
+
+                const auto collect_state = state_requested_.exchange(false);
+
+                // Layers which are still busy with a late frame from a previous tick are not restarted.
                 for (auto& p : layers_) {
-                    auto& layer = p.second;
-                    auto& tween = tweens_[p.first];
-
-                    layer_frame res    = {};
-                    res.foreground     = draw_frame::push(layer.receive(format_desc, nb_samples), tween.fetch());
-                    res.has_background = layer.has_background();
-                    if (std::find(fetch_background.begin(), fetch_background.end(), p.first) !=
-                        fetch_background.end()) {
-                        res.background = layer.receive_background(format_desc, nb_samples);
+                    if (pending_.find(p.first) != pending_.end()) {
+                        continue;
                     }
-                    frames[p.first] = res;
+
+                    auto layer = &p.second;
+                    auto background =
+                        std::find(fetch_background.begin(), fetch_background.end(), p.first) != fetch_background.end();
+
+                    auto task = std::make_shared<std::packaged_task<layer_result()>>([=] {
+                        caspar::timer produce_timer;
+
+                        layer_result result;
+                        result.frame.foreground     = layer->receive(format_desc, nb_samples);
+                        result.frame.has_background = layer->has_background();
+                        if (background) {
+                            result.frame.background = layer->receive_background(format_desc, nb_samples);
+                        }
+                        if (collect_state) {
+                            result.state = std::make_shared<monitor::state>(layer->state());
+                        }
+                        result.produce_time = produce_timer.elapsed();
+                        return result;
+                    });
+
+                    pending_.emplace(p.first, task->get_future());
+                    arena_.enqueue([task] { (*task)(); });
                 }
 
-                monitor::state state;
                 for (auto& p : layers_) {
-                    state["layer"][p.first] = p.second.state();
+                    auto& future = pending_[p.first];
+
+                    auto ready = true;
+                    if (layer_deadline_ > 0.0) {
+                        ready = future.wait_until(deadline) == std::future_status::ready;
+                    }
+
+                    layer_frame res = {};
+                    if (ready) {
+                        auto result = future.get();
+                        pending_.erase(p.first);
+
+                        graph_->set_value("layer-" + std::to_string(p.first) + "-produce-time",
+                                          result.produce_time * format_desc.fps * 0.5);
+
+                        res                   = result.frame;
+                        last_frames_[p.first] = result.frame;
+                        if (result.state) {
+                            layer_states_[p.first] = std::move(result.state);
+                        }
+                    } else {
+                        graph_->set_tag(diagnostics::tag_severity::WARNING, "late-layer");
+
+                        res            = last_frames_[p.first];
+                        res.foreground = draw_frame::still(res.foreground);
+                        res.background = draw_frame::still(res.background);
+                    }
+
+                    res.foreground  = draw_frame::push(res.foreground, current_transform(p.first));
+                    frames[p.first] = res;
+                }
+
+                for (auto& p : held_frames_) {
+                    if (frames.find(p.first) != frames.end()) {
+                        continue;
+                    }
+
+                    auto res        = p.second;
+                    res.foreground  = draw_frame::push(draw_frame::still(res.foreground), current_transform(p.first));
+                    res.background  = draw_frame::still(res.background);
+                    frames[p.first] = res;
+                }
+
+                if (collect_state) {
+                    std::lock_guard<std::mutex> lock(state_mutex_);
+                    published_states_ = layer_states_;
                 }
-                state_ = std::move(state);
             } catch (...) {
-                layers_.clear();
+                clear_layers();
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
 
@@ -97,8 +309,141 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         });
     }
 
+    frame_transform current_transform(int index)
+    {
+        auto transform = tweens_[index].fetch();
+
+        auto it = animations_.find(index);
+        if (it != animations_.end()) {
+            it->second.animation->apply(std::max(0, it->second.frame), transform);
+        }
+        return transform;
+    }
+
+    void apply_scheduled(int64_t frame)
+    {
+        std::vector<call_t> calls;
+        {
+            std::lock_guard<std::mutex> lock(timeline_mutex_);
+
+            while (!timeline_.empty() && timeline_.begin()->first <= frame) {
+                if (timeline_.begin()->first < frame) {
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "late-command");
+                }
+                auto& due = timeline_.begin()->second;
+                std::move(due.begin(), due.end(), std::back_inserter(calls));
+                timeline_.erase(timeline_.begin());
+            }
+        }
+
+        // Calls run in the order they were posted. Those that cannot run yet go first on the next tick, ahead of
+        // anything posted after them.
+        std::vector<call_t> retry;
+        for (auto& call : calls) {
+            if (!call()) {
+                retry.push_back(std::move(call));
+            }
+        }
+        backlog_.insert(backlog_.begin(), std::make_move_iterator(retry.begin()), std::make_move_iterator(retry.end()));
+    }
+
+    void apply_posted(std::chrono::steady_clock::time_point deadline)
+    {
+        call_t call;
+        while (mailbox_.try_pop(call)) {
+            backlog_.push_back(std::move(call));
+        }
+
+        // At least one call runs every tick, so that a slow one cannot stall the rest forever. A call that cannot run
+        // yet is retried on the next tick without holding back the calls behind it.
+        std::vector<call_t> retry;
+        auto                first = true;
+        while (!backlog_.empty() && (first || std::chrono::steady_clock::now() < deadline)) {
+            auto call = std::move(backlog_.front());
+            backlog_.pop_front();
+            if (!call()) {
+                retry.push_back(std::move(call));
+            }
+            first = false;
+        }
+        backlog_.insert(backlog_.begin(), std::make_move_iterator(retry.begin()), std::make_move_iterator(retry.end()));
+
+        if (!backlog_.empty()) {
+            graph_->set_tag(diagnostics::tag_severity::SILENT, "command-backlog");
+        }
+    }
+
+    void post(call_t call)
+    {
+        auto frame = stage_schedule::for_thread().frame;
+        if (frame < 0) {
+            mailbox_.push(std::move(call));
+        } else {
+            std::lock_guard<std::mutex> lock(timeline_mutex_);
+            timeline_[frame].push_back(std::move(call));
+        }
+    }
+
+    // Runs func on the stage at the next tick, or at the tick scheduled on the calling thread.
+    template <typename Func>
+    auto dispatch(Func&& func) -> std::future<decltype(func())>
+    {
+        auto task   = std::make_shared<std::packaged_task<decltype(func())()>>(std::forward<Func>(func));
+        auto future = task->get_future();
+        post([task] {
+            (*task)();
+            return true;
+        });
+        return future;
+    }
+
+    void wait_layer(int index)
+    {
+        auto it = pending_.find(index);
+        if (it == pending_.end()) {
+            return;
+        }
+
+        try {
+            it->second.wait();
+            auto result         = it->second.get();
+            last_frames_[index] = result.frame;
+            if (result.state) {
+                layer_states_[index] = std::move(result.state);
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        pending_.erase(it);
+    }
+
+    void wait_layers()
+    {
+        while (!pending_.empty()) {
+            wait_layer(pending_.begin()->first);
+        }
+    }
+
+    void erase_layer(int index)
+    {
+        wait_layer(index);
+        layers_.erase(index);
+        last_frames_.erase(index);
+        layer_states_.erase(index);
+    }
+
+    void clear_layers()
+    {
+        wait_layers();
+        layers_.clear();
+        last_frames_.clear();
+        layer_states_.clear();
+    }
+
     layer& get_layer(int index)
     {
+        wait_layer(index);
+
         auto it = layers_.find(index);
         if (it == std::end(layers_)) {
             it = layers_.emplace(index, layer()).first;
@@ -109,7 +454,7 @@ struct stage::impl : public std::enable_shared_from_this<impl>
     std::future<void>
     apply_transforms(const std::vector<std::tuple<int, stage::transform_func_t, unsigned int, tweener>>& transforms)
     {
-        return executor_.begin_invoke([=] {
+        return dispatch([=] {
             for (auto& transform : transforms) {
                 auto& tween = tweens_[std::get<0>(transform)];
                 auto  src   = tween.fetch();
@@ -125,7 +470,7 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                                       unsigned int                   mix_duration,
                                       const tweener&                 tween)
     {
-        return executor_.begin_invoke([=] {
+        return dispatch([=] {
             auto src       = tweens_[index].fetch();
             auto dst       = transform(src);
             tweens_[index] = tweened_transform(src, dst, mix_duration, tween);
@@ -134,52 +479,69 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> clear_transforms(int index)
     {
-        return executor_.begin_invoke([=] { tweens_.erase(index); });
+        return dispatch([=] {
+            tweens_.erase(index);
+            animations_.erase(index);
+        });
     }
 
     std::future<void> clear_transforms()
     {
-        return executor_.begin_invoke([=] { tweens_.clear(); });
+        return dispatch([=] {
+            tweens_.clear();
+            animations_.clear();
+        });
     }
 
     std::future<frame_transform> get_current_transform(int index)
     {
-        return executor_.begin_invoke([=] { return tweens_[index].fetch(); });
+        return dispatch([=] { return current_transform(index); });
+    }
+
+    std::future<void> animate(int index, const std::shared_ptr<const animation>& animation)
+    {
+        return dispatch([=] {
+            if (animation) {
+                animations_[index] = layer_animation{animation, -1};
+            } else {
+                animations_.erase(index);
+            }
+        });
     }
 
     std::future<void> load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview, bool auto_play)
     {
-        return executor_.begin_invoke([=] { get_layer(index).load(producer, preview, auto_play); });
+        return dispatch([=] { get_layer(index).load(producer, preview, auto_play); });
     }
 
     std::future<void> pause(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).pause(); });
+        return dispatch([=] { get_layer(index).pause(); });
     }
 
     std::future<void> resume(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).resume(); });
+        return dispatch([=] { get_layer(index).resume(); });
     }
 
     std::future<void> play(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).play(); });
+        return dispatch([=] { get_layer(index).play(); });
     }
 
     std::future<void> stop(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).stop(); });
+        return dispatch([=] { get_layer(index).stop(); });
     }
 
     std::future<void> clear(int index)
     {
-        return executor_.begin_invoke([=] { layers_.erase(index); });
+        return dispatch([=] { erase_layer(index); });
     }
 
     std::future<void> clear()
     {
-        return executor_.begin_invoke([=] { layers_.clear(); });
+        return dispatch([=] { clear_layers(); });
     }
 
     std::future<void> swap_layers(stage& other, bool swap_transforms)
@@ -190,26 +552,20 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             return make_ready_future();
         }
 
-        auto func = [=] {
-            auto layers       = layers_ | boost::adaptors::map_values;
-            auto other_layers = other_impl->layers_ | boost::adaptors::map_values;
-
-            std::swap(layers_, other_impl->layers_);
-
-            if (swap_transforms)
-                std::swap(tweens_, other_impl->tweens_);
-        };
-
-        return invoke_both(other, func);
+        return hand_over(other_impl, boost::none, boost::none, swap_transforms);
     }
 
     std::future<void> swap_layer(int index, int other_index, bool swap_transforms)
     {
-        return executor_.begin_invoke([=] {
+        return dispatch([=] {
             std::swap(get_layer(index), get_layer(other_index));
+            std::swap(last_frames_[index], last_frames_[other_index]);
+            swap_layer_states(layer_states_, index, layer_states_, other_index);
 
-            if (swap_transforms)
+            if (swap_transforms) {
                 std::swap(tweens_[index], tweens_[other_index]);
+                swap_animations(animations_, index, animations_, other_index);
+            }
         });
     }
 
@@ -219,48 +575,161 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
         if (other_impl.get() == this)
             return swap_layer(index, other_index, swap_transforms);
-        auto func = [=] {
-            auto& my_layer    = get_layer(index);
-            auto& other_layer = other_impl->get_layer(other_index);
 
-            std::swap(my_layer, other_layer);
+        return hand_over(other_impl, index, other_index, swap_transforms);
+    }
 
-            if (swap_transforms) {
-                auto& my_tween    = tweens_[index];
-                auto& other_tween = other_impl->tweens_[other_index];
-                std::swap(my_tween, other_tween);
+    // Takes a layer, or all of them, out of the stage. Their last frames are repeated until attach() is called.
+    layer_handoff detach(boost::optional<int> index, bool transforms)
+    {
+        layer_handoff handoff;
+        handoff.index = index;
+
+        if (index) {
+            wait_layer(*index);
+
+            auto last_frame = last_frames_.find(*index);
+            if (last_frame != last_frames_.end()) {
+                held_frames_[*index] = last_frame->second;
             }
-        };
 
-        return invoke_both(other, func);
+            move_entry(layers_, *index, handoff.layers, *index);
+            move_entry(last_frames_, *index, handoff.last_frames, *index);
+            move_entry(layer_states_, *index, handoff.layer_states, *index);
+            if (transforms) {
+                move_entry(tweens_, *index, handoff.tweens, *index);
+                move_entry(animations_, *index, handoff.animations, *index);
+            }
+        } else {
+            wait_layers();
+
+            held_frames_ = last_frames_;
+
+            handoff.layers       = std::move(layers_);
+            handoff.last_frames  = std::move(last_frames_);
+            handoff.layer_states = std::move(layer_states_);
+            layers_.clear();
+            last_frames_.clear();
+            layer_states_.clear();
+            if (transforms) {
+                handoff.tweens     = std::move(tweens_);
+                handoff.animations = std::move(animations_);
+                tweens_.clear();
+                animations_.clear();
+            }
+        }
+
+        return handoff;
     }
 
-    std::future<void> invoke_both(stage& other, std::function<void()> func)
+    // Puts the layers of a handoff in place of the ones the stage had at index, or in place of all of them.
+    void attach(layer_handoff& handoff, boost::optional<int> index, bool transforms)
     {
-        auto other_impl = other.impl_;
-
-        if (other_impl->channel_index_ < channel_index_) {
-            return other_impl->executor_.begin_invoke([=] { executor_.invoke(func); });
+        if (index) {
+            erase_layer(*index);
+            held_frames_.erase(*index);
+
+            move_entry(handoff.layers, *handoff.index, layers_, *index);
+            move_entry(handoff.last_frames, *handoff.index, last_frames_, *index);
+            move_entry(handoff.layer_states, *handoff.index, layer_states_, *index);
+            if (transforms) {
+                tweens_.erase(*index);
+                animations_.erase(*index);
+                move_entry(handoff.tweens, *handoff.index, tweens_, *index);
+                move_entry(handoff.animations, *handoff.index, animations_, *index);
+            }
+        } else {
+            clear_layers();
+            held_frames_.clear();
+
+            layers_       = std::move(handoff.layers);
+            last_frames_  = std::move(handoff.last_frames);
+            layer_states_ = std::move(handoff.layer_states);
+            if (transforms) {
+                tweens_     = std::move(handoff.tweens);
+                animations_ = std::move(handoff.animations);
+            }
         }
+    }
 
-        return executor_.begin_invoke([=] { other_impl->executor_.invoke(func); });
+    // Swaps layers with another stage without either tick waiting for the other. This stage hands its layers over on
+    // its tick, the other stage swaps them for its own on its tick and hands those back, which this stage puts in
+    // place on its next tick. Until then this stage repeats the last frames of the layers it handed over.
+    std::future<void> hand_over(const std::shared_ptr<impl>& other_impl,
+                                boost::optional<int>         index,
+                                boost::optional<int>         other_index,
+                                bool                         swap_transforms)
+    {
+        auto self    = shared_from_this();
+        auto promise = std::make_shared<std::promise<void>>();
+        auto future  = promise->get_future();
+
+        post([=] {
+            auto mine = std::make_shared<layer_handoff>(detach(index, swap_transforms));
+
+            other_impl->mailbox_.push([=] {
+                try {
+                    auto theirs = std::make_shared<layer_handoff>(other_impl->detach(other_index, swap_transforms));
+                    other_impl->attach(*mine, other_index, swap_transforms);
+
+                    self->mailbox_.push([=] {
+                        try {
+                            self->attach(*theirs, index, swap_transforms);
+                            promise->set_value();
+                        } catch (...) {
+                            promise->set_exception(std::current_exception());
+                        }
+                        return true;
+                    });
+                } catch (...) {
+                    // Whatever is left of this stage's layers goes back to it.
+                    promise->set_exception(std::current_exception());
+                    self->mailbox_.push([=] {
+                        self->attach(*mine, index, swap_transforms);
+                        return true;
+                    });
+                }
+                return true;
+            });
+            return true;
+        });
+
+        return future;
     }
 
     std::future<std::shared_ptr<frame_producer>> foreground(int index)
     {
-        return executor_.begin_invoke(
-            [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).foreground(); });
+        return dispatch([=]() -> std::shared_ptr<frame_producer> { return get_layer(index).foreground(); });
     }
 
     std::future<std::shared_ptr<frame_producer>> background(int index)
     {
-        return executor_.begin_invoke(
-            [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).background(); });
+        return dispatch([=]() -> std::shared_ptr<frame_producer> { return get_layer(index).background(); });
     }
 
     std::future<std::wstring> call(int index, const std::vector<std::wstring>& params)
     {
-        return flatten(executor_.begin_invoke([=] { return get_layer(index).foreground()->call(params).share(); }));
+        return flatten(dispatch([=] { return get_layer(index).foreground()->call(params).share(); }));
+    }
+
+    monitor::state state() const
+    {
+        state_requested_ = true;
+
+        std::map<int, std::shared_ptr<const monitor::state>> layer_states;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            layer_states = published_states_;
+        }
+
+        monitor::state state;
+        state["frame"] = frame_number_.load();
+        for (auto& p : layer_states) {
+            if (p.second) {
+                state["layer"][p.first] = *p.second;
+            }
+        }
+        return state;
     }
 };
 
@@ -286,6 +755,10 @@ std::future<void> stage::apply_transform(int
 std::future<void>            stage::clear_transforms(int index) { return impl_->clear_transforms(index); }
 std::future<void>            stage::clear_transforms() { return impl_->clear_transforms(); }
 std::future<frame_transform> stage::get_current_transform(int index) { return impl_->get_current_transform(index); }
+std::future<void>            stage::animate(int index, const std::shared_ptr<const animation>& animation)
+{
+    return impl_->animate(index, animation);
+}
 std::future<void> stage::load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview, bool auto_play)
 {
     return impl_->load(index, producer, preview, auto_play);
@@ -315,5 +788,6 @@ std::map<int, layer_frame>                   stage::
 {
     return (*impl_)(format_desc, nb_samples, fetch_background);
 }
-core::monitor::state stage::state() const { return impl_->state_; }
+core::monitor::state stage::state() const { return impl_->state(); }
+int64_t              stage::frame_number() const { return impl_->frame_number_; }
 }} // namespace caspar::core
@@ -30,6 +30,7 @@
 
 #include <core/frame/draw_frame.h>
 
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <map>
@@ -47,6 +48,31 @@ struct layer_frame
     bool       has_background;
 };
 
+// Stage calls made on a thread while a frame is scheduled are held by the stage and applied together at the start of
+// the tick producing that frame (see stage::frame_number), instead of whenever the stage gets to them.
+struct stage_schedule
+{
+    int64_t frame = -1;
+
+    static stage_schedule& for_thread();
+};
+
+class scoped_stage_schedule
+{
+    stage_schedule saved_;
+
+    scoped_stage_schedule(const scoped_stage_schedule&) = delete;
+    scoped_stage_schedule& operator=(const scoped_stage_schedule&) = delete;
+
+  public:
+    explicit scoped_stage_schedule(int64_t frame)
+        : saved_(stage_schedule::for_thread())
+    {
+        stage_schedule::for_thread().frame = frame;
+    }
+    ~scoped_stage_schedule() { stage_schedule::for_thread() = saved_; }
+};
+
 class stage final
 {
     stage(const stage&);
@@ -67,6 +93,9 @@ class stage final
     std::future<void>            clear_transforms(int index);
     std::future<void>            clear_transforms();
     std::future<frame_transform> get_current_transform(int index);
+
+    // Plays the animation on top of the transform of the layer, replacing any previous one. nullptr removes it.
+    std::future<void> animate(int index, const std::shared_ptr<const animation>& animation);
     std::future<void>
                               load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview = false, bool auto_play = false);
     std::future<void>         pause(int index);
@@ -82,6 +111,9 @@ class stage final
 
     core::monitor::state state() const;
 
+    // Number of the last frame the stage has started producing.
+    int64_t frame_number() const;
+
     std::future<std::shared_ptr<frame_producer>> foreground(int index);
     std::future<std::shared_ptr<frame_producer>> background(int index);
 
@@ -33,12 +33,23 @@
 #include "producer/stage.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/executor.h>
 #include <common/timer.h>
 
 #include <core/diagnostics/call_context.h>
 #include <core/mixer/image/image_mixer.h>
 
+#include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -48,9 +59,74 @@ namespace caspar { namespace core {
 
 bool operator<(const route_id& a, const route_id& b) { return a.mode + (a.index << 2) < b.mode + (b.index << 2); }
 
+void route::publish(draw_frame frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        sync_frame_ = std::move(frame);
+        sync_count_ += 1;
+    }
+    sync_cond_.notify_all();
+}
+
+bool route::wait(uint64_t& count, draw_frame& frame, std::chrono::microseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(sync_mutex_);
+    if (!sync_cond_.wait_for(lock, timeout, [&] { return sync_count_ != count; })) {
+        return false;
+    }
+    count = sync_count_;
+    frame = sync_frame_;
+    return true;
+}
+
+draw_frame route::latest() const
+{
+    std::lock_guard<std::mutex> lock(sync_mutex_);
+    return sync_frame_;
+}
+
+struct produced_frame
+{
+    core::video_format_desc    format_desc;
+    int                        nb_samples = 0;
+    std::map<int, layer_frame> stage_frames;
+};
+
+draw_frame route_frame(const route_id& id, const std::map<int, layer_frame>& stage_frames)
+{
+    if (id.index == -1) {
+        std::vector<core::draw_frame> frames;
+        for (auto& p : stage_frames) {
+            frames.push_back(p.second.foreground);
+        }
+        return core::draw_frame(std::move(frames));
+    }
+
+    auto it = stage_frames.find(id.index);
+    if (it == stage_frames.end()) {
+        // Layer doesnt exist, so send empty frame to avoid freezing on last
+        return draw_frame{};
+    }
+
+    if (id.mode == route_mode::background || (id.mode == route_mode::next && it->second.has_background)) {
+        return draw_frame::pop(it->second.background);
+    }
+    return draw_frame::pop(it->second.foreground);
+}
+
 struct video_channel::impl final
 {
-    monitor::state state_;
+    // The last state built, either for the tick callback or for state(), and the tick it was built on. It is rebuilt
+    // at least once a second, and on every tick for a few ticks after state() was called.
+    mutable std::mutex              state_mutex_;
+    mutable std::condition_variable state_cond_;
+    monitor::state                  state_;
+    std::uint64_t                   state_tick_ = 0;
+    std::size_t                     state_size_ = 0;
+    int                             state_age_  = 0;
+    mutable std::atomic<int>        state_requests_{0};
+    std::atomic<std::uint64_t>      tick_count_{0};
 
     const int index_;
 
@@ -70,19 +146,29 @@ struct video_channel::impl final
 
     uint64_t frame_counter_ = 0;
 
-    std::function<void(core::monitor::state)> tick_;
+    video_channel::tick_t tick_;
 
-    std::map<route_id, std::weak_ptr<core::route>> routes_;
-    std::mutex                                     routes_mutex_;
+    // Routes are read every tick and rarely added, so the channel threads read an immutable snapshot and only
+    // route() takes the mutex to replace it.
+    using routes_t = std::map<route_id, std::weak_ptr<core::route>>;
+
+    std::shared_ptr<const routes_t> routes_ = std::make_shared<routes_t>();
+    std::mutex                      routes_mutex_;
+
+    // Number of frames the stage may produce ahead of mix and consume, 0 runs all three in sequence.
+    const int pipeline_depth_ = std::max(0, env::properties().get(L"configuration.pipeline-depth", 0));
+
+    tbb::concurrent_bounded_queue<std::shared_ptr<produced_frame>> pipeline_;
 
     std::atomic<bool> abort_request_{false};
+    std::thread       produce_thread_;
     std::thread       thread_;
 
   public:
-    impl(int                                       index,
-         const core::video_format_desc&            format_desc,
-         std::unique_ptr<image_mixer>              image_mixer,
-         std::function<void(core::monitor::state)> tick)
+    impl(int                            index,
+         const core::video_format_desc& format_desc,
+         std::unique_ptr<image_mixer>   image_mixer,
+         video_channel::tick_t          tick)
         : index_(index)
         , format_desc_(format_desc)
         , output_(graph_, format_desc, index)
@@ -101,104 +187,53 @@ struct video_channel::impl final
 
         CASPAR_LOG(info) << print() << " Successfully Initialized.";
 
-        thread_ = std::thread([=] {
+        if (pipeline_depth_ > 0) {
+            graph_->set_color("pipeline", caspar::diagnostics::color(0.2f, 0.9f, 0.9f));
+            pipeline_.set_capacity(pipeline_depth_);
+
+            produce_thread_ = std::thread([=] {
 #ifdef WIN32
-            SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+                SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
 #endif
-            set_thread_name(L"channel-" + std::to_wstring(index_));
+                set_thread_name(L"channel-" + std::to_wstring(index_) + L"-produce");
 
-            while (!abort_request_) {
-                try {
-                    core::video_format_desc format_desc;
-                    {
-                        std::lock_guard<std::mutex> lock(format_desc_mutex_);
-                        format_desc = format_desc_;
+                while (!abort_request_) {
+                    try {
+                        pipeline_.push(std::make_shared<produced_frame>(produce()));
+                    } catch (...) {
+                        CASPAR_LOG_CURRENT_EXCEPTION();
                     }
+                }
 
-                    frame_counter_ += 1;
+                // Tell the channel thread that no more frames will be produced.
+                pipeline_.push(nullptr);
+            });
+        }
 
-                    auto nb_samples = format_desc.audio_cadence[frame_counter_ % format_desc.audio_cadence.size()];
+        thread_ = std::thread([=] {
+#ifdef WIN32
+            SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+            set_thread_name(L"channel-" + std::to_wstring(index_));
 
+            while (pipeline_depth_ > 0 || !abort_request_) {
+                try {
                     caspar::timer frame_timer;
 
-                    // Determine all layers that need a frame from the background producer
-                    std::vector<int> background_routes = {};
-                    {
-                        std::lock_guard<std::mutex> lock(routes_mutex_);
-
-                        for (auto& r : routes_) {
-                            // Ensure pointer is still valid
-                            if (!r.second.lock())
-                                continue;
-
-                            if (r.first.mode != route_mode::foreground) {
-                                background_routes.push_back(r.first.index);
-                            }
+                    std::shared_ptr<produced_frame> produced;
+                    if (pipeline_depth_ > 0) {
+                        pipeline_.pop(produced);
+                        if (!produced) {
+                            return;
                         }
+                        graph_->set_value("pipeline", static_cast<double>(pipeline_.size() + 1) / pipeline_depth_);
+                    } else {
+                        produced = std::make_shared<produced_frame>(produce());
                     }
 
-                    // Produce
-                    caspar::timer produce_timer;
-                    auto          stage_frames = stage_(format_desc, nb_samples, background_routes);
-                    graph_->set_value("produce-time", produce_timer.elapsed() * format_desc.fps * 0.5);
-
-                    // Mix
-                    caspar::timer mix_timer;
+                    consume(*produced);
 
-                    std::vector<core::draw_frame> frames;
-                    for (auto& p : stage_frames) {
-                        frames.push_back(p.second.foreground);
-                    }
-
-                    auto mixed_frame = mixer_(frames, format_desc, nb_samples);
-                    graph_->set_value("mix-time", mix_timer.elapsed() * format_desc.fps * 0.5);
-
-                    // Consume
-                    caspar::timer consume_timer;
-                    output_(std::move(mixed_frame), format_desc);
-                    graph_->set_value("consume-time", consume_timer.elapsed() * format_desc.fps * 0.5);
-
-                    graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
-
-                    {
-                        std::lock_guard<std::mutex> lock(routes_mutex_);
-
-                        for (auto& r : routes_) {
-                            auto route = r.second.lock();
-                            if (!route) {
-                                continue;
-                            }
-
-                            if (r.first.index == -1) {
-                                route->signal(core::draw_frame(std::move(frames)));
-                                continue;
-                            }
-
-                            auto it = stage_frames.find(r.first.index);
-                            if (it == stage_frames.end()) {
-                                // Layer doesnt exist, so send empty frame to avoid freezing on last
-                                route->signal(draw_frame{});
-                            } else {
-                                if (r.first.mode == route_mode::background ||
-                                    (r.first.mode == route_mode::next && it->second.has_background)) {
-                                    route->signal(draw_frame::pop(it->second.background));
-                                } else {
-                                    route->signal(draw_frame::pop(it->second.foreground));
-                                }
-                            }
-                        }
-                    }
-
-                    monitor::state state = {};
-                    state["stage"]       = stage_.state();
-                    state["mixer"]       = mixer_.state();
-                    state["output"]      = output_.state();
-                    state["framerate"]   = {format_desc_.framerate.numerator(), format_desc_.framerate.denominator()};
-                    state_               = state;
-
-                    caspar::timer osc_timer;
-                    tick_(state_);
-                    graph_->set_value("osc-time", osc_timer.elapsed() * format_desc.fps * 0.5);
+                    graph_->set_value("frame-time", frame_timer.elapsed() * produced->format_desc.fps * 0.5);
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
                 }
@@ -210,9 +245,149 @@ struct video_channel::impl final
     {
         CASPAR_LOG(info) << print() << " Uninitializing.";
         abort_request_ = true;
+        if (produce_thread_.joinable()) {
+            produce_thread_.join();
+        }
         thread_.join();
     }
 
+    produced_frame produce()
+    {
+        produced_frame produced;
+        {
+            std::lock_guard<std::mutex> lock(format_desc_mutex_);
+            produced.format_desc = format_desc_;
+        }
+
+        frame_counter_ += 1;
+
+        auto& format_desc   = produced.format_desc;
+        produced.nb_samples = format_desc.audio_cadence[frame_counter_ % format_desc.audio_cadence.size()];
+
+        auto routes = std::atomic_load(&routes_);
+
+        // Determine all layers that need a frame from the background producer
+        std::vector<int> background_routes = {};
+        for (auto& r : *routes) {
+            // Ensure pointer is still valid
+            if (r.second.expired())
+                continue;
+
+            if (r.first.mode != route_mode::foreground) {
+                background_routes.push_back(r.first.index);
+            }
+        }
+
+        // Produce
+        caspar::timer produce_timer;
+        produced.stage_frames = stage_(format_desc, produced.nb_samples, background_routes);
+        graph_->set_value("produce-time", produce_timer.elapsed() * format_desc.fps * 0.5);
+
+        // Same tick routes get the frame before it is mixed, so that channels reading them can use it this tick.
+        for (auto& r : *routes) {
+            auto route = r.second.lock();
+            if (route && route->sync_readers > 0) {
+                route->publish(route_frame(r.first, produced.stage_frames));
+            }
+        }
+
+        return produced;
+    }
+
+    void consume(produced_frame& produced)
+    {
+        auto& format_desc  = produced.format_desc;
+        auto& stage_frames = produced.stage_frames;
+
+        tick_count_ += 1;
+
+        // Mix
+        caspar::timer mix_timer;
+
+        std::vector<core::draw_frame> frames;
+        for (auto& p : stage_frames) {
+            frames.push_back(p.second.foreground);
+        }
+
+        auto mixed_frame = mixer_(frames, format_desc, produced.nb_samples);
+        graph_->set_value("mix-time", mix_timer.elapsed() * format_desc.fps * 0.5);
+
+        // Consume
+        caspar::timer consume_timer;
+        output_(std::move(mixed_frame), format_desc);
+        graph_->set_value("consume-time", consume_timer.elapsed() * format_desc.fps * 0.5);
+
+        for (auto& r : *std::atomic_load(&routes_)) {
+            auto route = r.second.lock();
+            if (!route || route->signal.empty()) {
+                continue;
+            }
+
+            route->signal(route_frame(r.first, stage_frames));
+        }
+
+        boost::optional<monitor::state> state;
+        auto                            get_state = [&]() -> monitor::state {
+            if (!state) {
+                state = make_state(format_desc);
+            }
+            return *state;
+        };
+
+        caspar::timer osc_timer;
+        tick_(get_state);
+        graph_->set_value("osc-time", osc_timer.elapsed() * format_desc.fps * 0.5);
+
+        if (state_requests_ > 0) {
+            state_requests_ -= 1;
+            get_state();
+        } else if (!state && ++state_age_ >= format_desc.fps) {
+            get_state();
+        }
+    }
+
+    monitor::state make_state(const core::video_format_desc& format_desc)
+    {
+        monitor::state state;
+        state.reserve(state_size_);
+        state["stage"]     = stage_.state();
+        state["mixer"]     = mixer_.state();
+        state["output"]    = output_.state();
+        state["framerate"] = {format_desc.framerate.numerator(), format_desc.framerate.denominator()};
+        state_size_        = state.size();
+        state_age_         = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_      = state;
+            state_tick_ = tick_count_;
+        }
+        state_cond_.notify_all();
+
+        return state;
+    }
+
+    // Layer states are collected on the tick after the stage was asked for them, so the channel keeps refreshing the
+    // state for a couple of ticks (more with a pipeline) after each call. A state built on the last tick is returned
+    // as is. An older one may predate calls made just before, e.g. a LOAD, so this waits for the state that includes
+    // the layer states collected after the call, and only falls back to the old one if the channel is late.
+    monitor::state state() const
+    {
+        const auto ticks = 2 + pipeline_depth_;
+        const auto fps   = video_format_desc().fps;
+
+        state_requests_ = ticks;
+        const auto tick = tick_count_.load();
+
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        if (state_tick_ + 1 < tick) {
+            state_cond_.wait_for(lock, std::chrono::duration<double>((ticks + 1) / fps), [&] {
+                return state_tick_ >= tick + ticks;
+            });
+        }
+        return state_;
+    }
+
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground)
     {
         std::lock_guard<std::mutex> lock(routes_mutex_);
@@ -221,7 +396,15 @@ struct video_channel::impl final
         id.index    = index;
         id.mode     = mode;
 
-        auto route = routes_[id].lock();
+        auto routes = std::atomic_load(&routes_);
+
+        std::shared_ptr<core::route> route;
+
+        auto it = routes->find(id);
+        if (it != routes->end()) {
+            route = it->second.lock();
+        }
+
         if (!route) {
             route              = std::make_shared<core::route>();
             route->format_desc = format_desc_;
@@ -234,7 +417,16 @@ struct video_channel::impl final
             } else if (mode == route_mode::next) {
                 route->name += L"/next";
             }
-            routes_[id] = route;
+
+            auto next = std::make_shared<routes_t>();
+            for (auto& r : *routes) {
+                if (!r.second.expired()) {
+                    next->insert(r);
+                }
+            }
+            (*next)[id] = route;
+
+            std::atomic_store(&routes_, std::shared_ptr<const routes_t>(std::move(next)));
         }
 
         return route;
@@ -261,10 +453,10 @@ struct video_channel::impl final
     int index() const { return index_; }
 };
 
-video_channel::video_channel(int                                       index,
-                             const core::video_format_desc&            format_desc,
-                             std::unique_ptr<image_mixer>              image_mixer,
-                             std::function<void(core::monitor::state)> tick)
+video_channel::video_channel(int                            index,
+                             const core::video_format_desc& format_desc,
+                             std::unique_ptr<image_mixer>   image_mixer,
+                             tick_t                         tick)
     : impl_(new impl(index, format_desc, std::move(image_mixer), std::move(tick)))
 {
 }
@@ -282,7 +474,7 @@ void                           core::video_channel::video_format_desc(const core
     impl_->video_format_desc(format_desc);
 }
 int                  video_channel::index() const { return impl_->index(); }
-core::monitor::state video_channel::state() const { return impl_->state_; }
+core::monitor::state video_channel::state() const { return impl_->state(); }
 
 std::shared_ptr<route> video_channel::route(int index, route_mode mode) { return impl_->route(index, mode); }
 
@@ -24,13 +24,19 @@
 #include "fwd.h"
 #include "video_format.h"
 
+#include "frame/draw_frame.h"
 #include "monitor/monitor.h"
 
 #include <common/memory.h>
 
 #include <boost/signals2.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <mutex>
 
 namespace caspar { namespace core {
 
@@ -53,14 +59,27 @@ struct route
 {
     route()             = default;
     route(const route&) = delete;
-    route(route&&)      = default;
 
     route& operator=(const route&) = delete;
-    route& operator=(route&&) = default;
 
+    // Frames consumed by the source channel, one tick or more behind it.
     boost::signals2::signal<void(class draw_frame)> signal;
     video_format_desc                               format_desc;
     std::wstring                                    name;
+
+    // Same tick routes. The source channel publishes each frame as soon as its stage has produced it, and a
+    // synchronized reader waits for the frame of the current tick instead of reading it from a queue.
+    std::atomic<int> sync_readers{0};
+
+    void       publish(draw_frame frame);
+    bool       wait(uint64_t& count, draw_frame& frame, std::chrono::microseconds timeout);
+    draw_frame latest() const;
+
+  private:
+    mutable std::mutex      sync_mutex_;
+    std::condition_variable sync_cond_;
+    draw_frame              sync_frame_;
+    uint64_t                sync_count_ = 0;
 };
 
 class video_channel final
@@ -69,10 +88,13 @@ class video_channel final
     video_channel& operator=(const video_channel&);
 
   public:
-    explicit video_channel(int                                       index,
-                           const video_format_desc&                  format_desc,
-                           std::unique_ptr<image_mixer>              image_mixer,
-                           std::function<void(core::monitor::state)> on_tick);
+    // The state passed to on_tick is built on first call, so a tick without monitoring does not build it.
+    using tick_t = std::function<void(const std::function<core::monitor::state()>& state)>;
+
+    explicit video_channel(int                          index,
+                           const video_format_desc&     format_desc,
+                           std::unique_ptr<image_mixer> image_mixer,
+                           tick_t                       on_tick);
     ~video_channel();
 
     core::monitor::state state() const;
@@ -77,7 +77,8 @@ void init(core::module_dependencies dependencies)
 
     dependencies.consumer_registry->register_consumer_factory(L"Bluefish Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"bluefish", create_preconfigured_consumer);
-    dependencies.producer_registry->register_producer_factory(L"Bluefish Producer", create_producer);
+    dependencies.producer_registry->register_producer_factory(
+        L"Bluefish Producer", create_producer, {{L"BLUEFISH"}, {}, {}});
 }
 
 }} // namespace caspar::bluefish
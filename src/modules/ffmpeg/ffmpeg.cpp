@@ -24,14 +24,21 @@
 #include "ffmpeg.h"
 
 #include "consumer/ffmpeg_consumer.h"
+#include "producer/av_keyframe_index.h"
+#include "producer/clip_cache.h"
 #include "producer/ffmpeg_producer.h"
+#include "producer/thumbnail_generator.h"
 
 #include <common/log.h>
+#include <common/utf.h>
 
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/media_info/media_scanner.h>
 
+#include <memory>
 #include <mutex>
+#include <sstream>
 
 #if defined(_MSC_VER)
 #pragma warning(disable : 4244)
@@ -141,6 +148,70 @@ void log_callback(void* ptr, int level, const char* fmt, va_list vl)
 
 void log_for_thread(void* ptr, int level, const char* fmt, va_list vl) { log_callback(ptr, level, fmt, vl); }
 
+bool extract_media_info(const std::wstring& path, core::media_info& info)
+{
+    if (!is_valid_file(path))
+        return false;
+
+    AVFormatContext* ctx = nullptr;
+    if (avformat_open_input(&ctx, u8(path).c_str(), nullptr, nullptr) < 0)
+        return false;
+
+    std::shared_ptr<AVFormatContext> ctx_ptr(ctx, [](AVFormatContext* ptr) { avformat_close_input(&ptr); });
+
+    if (avformat_find_stream_info(ctx, nullptr) < 0)
+        return false;
+
+    auto has_audio = false;
+    auto has_video = false;
+
+    std::wstringstream streams;
+    for (auto n = 0U; n < ctx->nb_streams; ++n) {
+        const auto st  = ctx->streams[n];
+        const auto par = st->codecpar;
+
+        if (par->codec_type != AVMEDIA_TYPE_VIDEO && par->codec_type != AVMEDIA_TYPE_AUDIO)
+            continue;
+
+        if (!streams.str().empty())
+            streams << L", ";
+        streams << u16(avcodec_get_name(par->codec_id));
+
+        if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+            streams << L" " << par->sample_rate << L"Hz " << par->channels << L"ch";
+            has_audio = true;
+            continue;
+        }
+
+        streams << L" " << par->width << L"x" << par->height;
+
+        if (has_video || (st->disposition & AV_DISPOSITION_ATTACHED_PIC))
+            continue;
+
+        has_video = true;
+
+        const auto framerate = av_guess_frame_rate(ctx, st, nullptr);
+        if (framerate.num > 0 && framerate.den > 0)
+            info.time_base = boost::rational<int64_t>(framerate.den, framerate.num);
+
+        info.clip_type = st->nb_frames == 1 || (ctx->iformat->flags & AVFMT_NOTIMESTAMPS) ? L"STILL" : L"MOVIE";
+    }
+
+    if (!has_video && !has_audio)
+        return false;
+
+    if (!has_video)
+        info.clip_type = L"AUDIO";
+
+    if (info.clip_type == L"MOVIE" && ctx->duration != AV_NOPTS_VALUE && info.time_base != 0)
+        info.duration = av_rescale(
+            ctx->duration, info.time_base.denominator(), info.time_base.numerator() * static_cast<int64_t>(AV_TIME_BASE));
+
+    info.format  = u16(ctx->iformat->name);
+    info.streams = streams.str();
+    return true;
+}
+
 void init(core::module_dependencies dependencies)
 {
     av_lockmgr_register(ffmpeg_lock_callback);
@@ -155,11 +226,24 @@ void init(core::module_dependencies dependencies)
     dependencies.consumer_registry->register_consumer_factory(L"FFmpeg Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ffmpeg", create_preconfigured_consumer);
 
-    dependencies.producer_registry->register_producer_factory(L"FFmpeg Producer", create_producer);
+    dependencies.producer_registry->register_producer_factory(
+        L"FFmpeg Producer",
+        create_producer,
+        {{}, {L"file", L"http", L"https", L"rtmp", L"rtmps", L"rtp", L"rtsp", L"srt", L"tcp", L"udp"},
+         supported_extensions()});
+
+    dependencies.media_scanner->register_extractor(extract_media_info);
+
+    init_thumbnails(dependencies);
+    init_clip_cache(dependencies);
 }
 
 void uninit()
 {
+    uninit_thumbnails();
+    uninit_clip_cache();
+    clear_producer_pool();
+    clear_keyframe_indices();
     // avfilter_uninit();
     avformat_network_deinit();
     av_lockmgr_register(nullptr);
@@ -1,4 +1,5 @@
 #include "av_input.h"
+#include "av_readahead.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
@@ -123,14 +124,26 @@ void Input::internal_reset()
         filename_    = u8(url_parts.second);
     }
 
-    if (input_format == nullptr) {
+    AVFormatContext*           ic = nullptr;
+    std::shared_ptr<Readahead> readahead;
+
+    if (input_format == nullptr && Readahead::enabled(filename_)) {
+        readahead = std::make_shared<Readahead>(filename_, AVIOInterruptCB{Input::interrupt_cb, this}, graph_);
+
+        ic = avformat_alloc_context();
+        if (!ic) {
+            FF_RET(AVERROR(ENOMEM), "avformat_alloc_context");
+        }
+        ic->pb = readahead->context();
+        ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+    } else if (input_format == nullptr) {
         // TODO (fix) timeout?
         FF(av_dict_set(&options, "rw_timeout", "60000000", 0)); // 60 second IO timeout
     }
 
-    AVFormatContext* ic = nullptr;
     FF(avformat_open_input(&ic, filename_.c_str(), input_format, &options));
-    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+    // The readahead is not closed with the format context, but must outlive it.
+    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [readahead](AVFormatContext* ctx) { avformat_close_input(&ctx); });
 
     for (auto& p : to_map(&options)) {
         CASPAR_LOG(warning) << "av_input[" + filename_ + "]"
@@ -141,12 +154,26 @@ void Input::internal_reset()
     ic2->interrupt_callback.opaque   = this;
 
     FF(avformat_find_stream_info(ic2.get(), nullptr));
+
+    if (readahead) {
+        auto byte_rate = ic2->bit_rate / 8;
+        if (byte_rate <= 0 && ic2->duration > 0) {
+            byte_rate = av_rescale(avio_size(ic2->pb), AV_TIME_BASE, ic2->duration);
+        }
+        if (byte_rate > 0) {
+            readahead->set_byte_rate(byte_rate);
+        }
+    }
+    readahead_capacity_ = readahead ? readahead->capacity() : 0;
+
     ic_ = std::move(ic2);
     ic_cond_.notify_all();
 }
 
 bool Input::eof() const { return eof_; }
 
+std::size_t Input::readahead_capacity() const { return readahead_capacity_; }
+
 void Input::seek(int64_t ts, bool flush)
 {
     std::unique_lock<std::mutex> lock(ic_mutex_);
@@ -37,6 +37,9 @@ class Input
     bool eof() const;
     void seek(int64_t ts, bool flush = true);
 
+    // The size of the readahead buffer of the open file, 0 without one.
+    std::size_t readahead_capacity() const;
+
   private:
     void internal_reset();
 
@@ -49,7 +52,8 @@ class Input
 
     tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> buffer_;
 
-    std::atomic<bool> eof_{false};
+    std::atomic<bool>        eof_{false};
+    std::atomic<std::size_t> readahead_capacity_{0};
 
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
@@ -0,0 +1,330 @@
+#include "av_keyframe_index.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+namespace caspar { namespace ffmpeg {
+
+int64_t KeyframeIndex::before(int64_t time) const
+{
+    if (intra_only) {
+        return time;
+    }
+
+    auto it = std::upper_bound(keyframes.begin(), keyframes.end(), time);
+    return it != keyframes.begin() ? *std::prev(it) : AV_NOPTS_VALUE;
+}
+
+namespace {
+
+class keyframe_indexer
+{
+    struct entry
+    {
+        std::uintmax_t                       size     = 0;
+        std::time_t                          modified = 0;
+        std::shared_ptr<const KeyframeIndex> index;
+    };
+
+    const std::wstring folder_ = env::properties().get(L"configuration.ffmpeg.producer.keyframe-index-path",
+                                                       env::data_folder() + L"keyframes/");
+
+    // Indexing reads whole files, so it is held to this many bytes per second to leave the storage to playout.
+    const double read_rate_ =
+        env::properties().get(L"configuration.ffmpeg.producer.keyframe-index-rate", 20.0) * 1024.0 * 1024.0;
+
+    std::mutex                   mutex_;
+    std::condition_variable      cond_;
+    std::map<std::string, entry> entries_;
+    std::deque<std::string>      queue_;
+    std::set<std::string>        queued_;
+    std::atomic<bool>            abort_{false};
+    std::thread                  thread_;
+
+    static int interrupt_cb(void* ctx) { return static_cast<keyframe_indexer*>(ctx)->abort_ ? 1 : 0; }
+
+    static bool stat(const std::string& filename, std::uintmax_t& size, std::time_t& modified)
+    {
+        boost::system::error_code ec;
+        size     = boost::filesystem::file_size(u16(filename), ec);
+        modified = ec ? 0 : boost::filesystem::last_write_time(u16(filename), ec);
+        return !ec;
+    }
+
+    std::wstring index_path(const std::string& filename) const
+    {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (auto c : filename) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+
+        std::wostringstream str;
+        str << folder_ << std::hex << std::setw(16) << std::setfill(L'0') << hash << L".idx";
+        return str.str();
+    }
+
+    std::shared_ptr<KeyframeIndex> load(const std::string& filename, std::uintmax_t size, std::time_t modified) const
+    {
+        std::ifstream file(u8(index_path(filename)), std::ios::binary);
+
+        std::string name;
+        if (!std::getline(file, name) || name != filename) {
+            return nullptr;
+        }
+
+        std::uintmax_t file_size     = 0;
+        std::time_t    file_modified = 0;
+        auto           index         = std::make_shared<KeyframeIndex>();
+        if (!(file >> file_size >> file_modified >> index->intra_only) || file_size != size ||
+            file_modified != modified) {
+            return nullptr;
+        }
+
+        int64_t time;
+        while (file >> time) {
+            index->keyframes.push_back(time);
+        }
+
+        return index;
+    }
+
+    void save(const std::string& filename, std::uintmax_t size, std::time_t modified, const KeyframeIndex& index)
+    {
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(folder_, ec);
+
+        const auto    path     = index_path(filename);
+        const auto    tmp_path = path + L".tmp";
+        std::ofstream file(u8(tmp_path), std::ios::binary | std::ios::trunc);
+
+        file << filename << '\n' << size << ' ' << modified << ' ' << index.intra_only << '\n';
+        for (auto time : index.keyframes) {
+            file << time << '\n';
+        }
+        file.close();
+
+        boost::filesystem::rename(tmp_path, path, ec);
+    }
+
+    // Reads the packets of the file without decoding them.
+    std::shared_ptr<KeyframeIndex> build(const std::string& filename)
+    {
+        auto index = std::make_shared<KeyframeIndex>();
+
+        auto ic = avformat_alloc_context();
+        if (!ic) {
+            FF_RET(AVERROR(ENOMEM), "avformat_alloc_context");
+        }
+        ic->interrupt_callback.callback = keyframe_indexer::interrupt_cb;
+        ic->interrupt_callback.opaque   = this;
+
+        FF(avformat_open_input(&ic, filename.c_str(), nullptr, nullptr));
+        const auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+
+        FF(avformat_find_stream_info(ic, nullptr));
+
+        const auto stream_index = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (stream_index < 0) {
+            // Audio seeks land where they are asked to.
+            index->intra_only = true;
+            return index;
+        }
+
+        const auto st   = ic->streams[stream_index];
+        const auto desc = avcodec_descriptor_get(st->codecpar->codec_id);
+        if (desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY)) {
+            index->intra_only = true;
+            return index;
+        }
+
+        for (auto n = 0U; n < ic->nb_streams; ++n) {
+            if (static_cast<int>(n) != stream_index) {
+                ic->streams[n]->discard = AVDISCARD_ALL;
+            }
+        }
+
+        caspar::timer timer;
+        const auto    packet = alloc_packet();
+        while (true) {
+            if (read_rate_ > 0.0) {
+                const auto ahead = avio_tell(ic->pb) / read_rate_ - timer.elapsed();
+                if (ahead > 0.0) {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cond_.wait_for(lock, std::chrono::duration<double>(ahead), [&] { return abort_.load(); });
+                }
+                if (abort_) {
+                    FF_RET(AVERROR_EXIT, "av_read_frame");
+                }
+            }
+
+            const auto ret = av_read_frame(ic, packet.get());
+            if (ret == AVERROR_EOF) {
+                break;
+            }
+            FF_RET(ret, "av_read_frame");
+
+            if (packet->stream_index == stream_index && (packet->flags & AV_PKT_FLAG_KEY)) {
+                const auto ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+                if (ts != AV_NOPTS_VALUE) {
+                    index->keyframes.push_back(av_rescale_q(ts, st->time_base, {1, AV_TIME_BASE}));
+                }
+            }
+            av_packet_unref(packet.get());
+        }
+
+        std::sort(index->keyframes.begin(), index->keyframes.end());
+        index->keyframes.erase(std::unique(index->keyframes.begin(), index->keyframes.end()), index->keyframes.end());
+
+        return index;
+    }
+
+    void run()
+    {
+        set_thread_name(L"[ffmpeg::keyframe_index]");
+        set_thread_low_priority();
+
+        while (true) {
+            std::string filename;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return abort_ || !queue_.empty(); });
+                if (abort_) {
+                    return;
+                }
+                filename = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            entry e;
+            try {
+                if (stat(filename, e.size, e.modified)) {
+                    auto index = load(filename, e.size, e.modified);
+                    if (!index) {
+                        index = build(filename);
+                        save(filename, e.size, e.modified, *index);
+                        CASPAR_LOG(debug) << L"[ffmpeg] Indexed " << index->keyframes.size() << L" keyframes in "
+                                          << u16(filename);
+                    }
+                    e.index = std::move(index);
+                }
+            } catch (...) {
+                if (!abort_) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_.erase(filename);
+            if (e.index) {
+                entries_[filename] = std::move(e);
+            }
+        }
+    }
+
+  public:
+    static keyframe_indexer& instance()
+    {
+        static keyframe_indexer indexer;
+        return indexer;
+    }
+
+    ~keyframe_indexer() { clear(); }
+
+    std::shared_ptr<const KeyframeIndex> find(const std::string& filename)
+    {
+        const auto protocol = protocol_split(u16(filename)).first;
+        if (!protocol.empty() && protocol != L"file") {
+            return nullptr;
+        }
+
+        std::uintmax_t size;
+        std::time_t    modified;
+        if (!stat(filename, size, modified)) {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = entries_.find(filename);
+        if (it != entries_.end() && it->second.size == size && it->second.modified == modified) {
+            return it->second.index;
+        }
+
+        if (abort_ || !queued_.insert(filename).second) {
+            return nullptr;
+        }
+
+        queue_.push_back(filename);
+        if (!thread_.joinable()) {
+            thread_ = std::thread([this] { run(); });
+        }
+        cond_.notify_one();
+
+        return nullptr;
+    }
+
+    void clear()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        queue_.clear();
+        queued_.clear();
+    }
+};
+
+} // namespace
+
+std::shared_ptr<const KeyframeIndex> find_keyframe_index(const std::string& filename)
+{
+    return keyframe_indexer::instance().find(filename);
+}
+
+void clear_keyframe_indices() { keyframe_indexer::instance().clear(); }
+
+}} // namespace caspar::ffmpeg
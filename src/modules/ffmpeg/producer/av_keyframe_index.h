@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+// Where the keyframes of a file's main video stream are, so that seeks can tell how far they are from the nearest
+// keyframe before deciding how to get there.
+struct KeyframeIndex
+{
+    bool                 intra_only = false; // every frame is a keyframe
+    std::vector<int64_t> keyframes;          // AV_TIME_BASE, sorted
+
+    // The last keyframe at or before time, or AV_NOPTS_VALUE if there is none.
+    int64_t before(int64_t time) const;
+};
+
+// The index of a local file if it is known, otherwise nullptr while it is loaded or built in the background. Indices
+// are saved, so each file is only read through once as long as it does not change.
+std::shared_ptr<const KeyframeIndex> find_keyframe_index(const std::string& filename);
+
+void clear_keyframe_indices();
+
+}} // namespace caspar::ffmpeg
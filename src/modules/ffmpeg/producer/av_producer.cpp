@@ -1,6 +1,7 @@
 #include "av_producer.h"
 
 #include "av_input.h"
+#include "av_keyframe_index.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
@@ -50,12 +51,18 @@ extern "C" {
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <deque>
 #include <iomanip>
+#include <map>
 #include <memory>
 #include <queue>
 #include <sstream>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace caspar { namespace ffmpeg {
 
@@ -77,15 +84,17 @@ struct Frame
 struct Decoder
 {
     AVStream*                             st = nullptr;
+    std::shared_ptr<void>                 direct_rendering;
     std::shared_ptr<AVCodecContext>       ctx;
-    int64_t                               next_pts = AV_NOPTS_VALUE;
+    int64_t                               next_pts    = AV_NOPTS_VALUE;
+    int64_t                               preroll_end = AV_NOPTS_VALUE; // frames before are decoded only to get there
     std::queue<std::shared_ptr<AVPacket>> input;
     std::shared_ptr<AVFrame>              frame;
     bool                                  eof = false;
 
     Decoder() = default;
 
-    explicit Decoder(AVStream* stream)
+    Decoder(AVStream* stream, const void* tag, std::shared_ptr<core::frame_factory> frame_factory)
         : st(stream)
     {
         const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
@@ -126,6 +135,8 @@ struct Decoder
             ctx->thread_type = FF_THREAD_SLICE;
         }
 
+        direct_rendering = enable_direct_rendering(ctx.get(), tag, std::move(frame_factory));
+
         FF(avcodec_open2(ctx.get(), codec, nullptr));
     }
 
@@ -142,6 +153,12 @@ struct Decoder
             if (input.empty()) {
                 return false;
             }
+            if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+                const auto& packet  = input.front();
+                const auto  preroll = packet && preroll_end != AV_NOPTS_VALUE && packet->pts != AV_NOPTS_VALUE &&
+                                     packet->pts < preroll_end;
+                ctx->skip_frame = preroll ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+            }
             FF(avcodec_send_packet(ctx.get(), input.front().get()));
             input.pop();
         } else if (ret == AVERROR_EOF) {
@@ -197,19 +214,29 @@ struct Filter
 
     Filter() = default;
 
-    Filter(std::string                    filter_spec,
-           const Input&                   input,
-           std::map<int, Decoder>&        streams,
-           int64_t                        start_time,
-           AVMediaType                    media_type,
-           const core::video_format_desc& format_desc)
+    Filter(std::string                                 filter_spec,
+           const Input&                                input,
+           std::map<int, Decoder>&                     streams,
+           int64_t                                     start_time,
+           AVMediaType                                 media_type,
+           const core::video_format_desc&              format_desc,
+           const void*                                 tag,
+           const std::shared_ptr<core::frame_factory>& frame_factory)
     {
+        // Decoders only render straight into frame factory buffers while the filters hand their pictures on untouched,
+        // since those buffers are slow to read back. That is without VF, without deinterlacing (bwdif passes progressive
+        // frames on as they are when only deinterlacing interlaced ones) and without the fps filter repeating frames.
+        auto        direct_rendering = false;
+        std::string deint;
+
         if (media_type == AVMEDIA_TYPE_VIDEO) {
+            direct_rendering = filter_spec.empty();
+
             if (filter_spec.empty()) {
                 filter_spec = "null";
             }
 
-            auto deint = u8(env::properties().get<std::wstring>(L"configuration.ffmpeg.producer.auto-deinterlace", L"interlaced"));
+            deint = u8(env::properties().get<std::wstring>(L"configuration.ffmpeg.producer.auto-deinterlace", L"interlaced"));
 
             if (deint != "none") {
                 filter_spec += (boost::format(",bwdif=mode=send_field:parity=auto:deint=%s") % deint).str();
@@ -306,7 +333,8 @@ struct Filter
             // https://github.com/CasparCG/server/issues/832
             if (video_av_streams.size() >= 2 &&
                 video_av_streams[0]->codecpar->height == video_av_streams[1]->codecpar->height) {
-                filter_spec = "alphamerge," + filter_spec;
+                filter_spec      = "alphamerge," + filter_spec;
+                direct_rendering = false;
             }
         }
 
@@ -350,7 +378,19 @@ struct Filter
 
                 auto it = streams.find(index);
                 if (it == streams.end()) {
-                    it = streams.emplace(index, input->streams[index]).first;
+                    const auto stream = input->streams[index];
+                    const auto direct = direct_rendering &&
+                                        (deint == "none" || (deint == "interlaced" &&
+                                                             stream->codecpar->field_order == AV_FIELD_PROGRESSIVE)) &&
+                                        av_cmp_q(av_guess_frame_rate(nullptr, stream, nullptr),
+                                                 {format_desc.framerate.numerator(),
+                                                  format_desc.framerate.denominator()}) == 0;
+
+                    it = streams
+                             .emplace(std::piecewise_construct,
+                                      std::forward_as_tuple(index),
+                                      std::forward_as_tuple(stream, tag, direct ? frame_factory : nullptr))
+                             .first;
                 }
 
                 auto st = it->second.ctx;
@@ -508,10 +548,11 @@ struct AVProducer::Impl
     const std::string                          name_;
     const std::string                          path_;
 
-    Input                  input_;
-    std::map<int, Decoder> decoders_;
-    Filter                 video_filter_;
-    Filter                 audio_filter_;
+    Input                                input_;
+    std::shared_ptr<const KeyframeIndex> keyframes_;
+    std::map<int, Decoder>               decoders_;
+    Filter                               video_filter_;
+    Filter                               audio_filter_;
 
     std::map<int, std::vector<AVFilterContext*>> sources_;
 
@@ -521,11 +562,23 @@ struct AVProducer::Impl
     std::atomic<int64_t> seek_{AV_NOPTS_VALUE};
     std::atomic<bool>    loop_{false};
 
+    // Opt-in cache of decoded frames around the playhead, so that stepping and short seeks need no decoding.
+    const std::size_t        scrub_cache_capacity_;
+    std::map<int64_t, Frame> scrub_cache_; // by pts
+    int64_t                  cache_only_until_ = AV_NOPTS_VALUE;
+
+    // The first frames after the in-point, kept while looping so that each pass follows the previous one without
+    // waiting for the decoders to restart.
+    std::vector<Frame> loop_head_;
+    int64_t            loop_head_start_    = AV_NOPTS_VALUE;
+    bool               loop_head_complete_ = false;
+
     std::string afilter_;
     std::string vfilter_;
 
     int64_t          frame_count_    = 0;
     bool             frame_flush_    = true;
+    bool             frame_eof_      = false;
     int64_t          frame_time_     = AV_NOPTS_VALUE;
     int64_t          frame_duration_ = AV_NOPTS_VALUE;
     core::draw_frame frame_;
@@ -559,6 +612,9 @@ struct AVProducer::Impl
         , start_(start ? av_rescale_q(*start, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , duration_(duration ? av_rescale_q(*duration, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , loop_(loop)
+        , scrub_cache_capacity_(env::properties().get(L"configuration.ffmpeg.producer.scrub-cache",
+                                                       static_cast<std::size_t>(0)) *
+                                1024 * 1024 / std::max(static_cast<std::size_t>(1), format_desc.size))
         , afilter_(afilter)
         , vfilter_(vfilter)
     {
@@ -595,6 +651,7 @@ struct AVProducer::Impl
         std::vector<int> audio_cadence = format_desc_.audio_cadence;
 
         input_.reset();
+        keyframes_ = find_keyframe_index(path_);
         {
             core::monitor::state streams;
             for (auto n = 0UL; n < input_->nb_streams; ++n) {
@@ -643,8 +700,11 @@ struct AVProducer::Impl
                 const auto seek = seek_.exchange(AV_NOPTS_VALUE);
 
                 if (seek != AV_NOPTS_VALUE) {
-                    seek_internal(seek);
                     frame = Frame{};
+                    if (!seek_cached(seek, frame)) {
+                        seek_internal(scrub_start(seek));
+                        cache_only_until_ = seek;
+                    }
                     continue;
                 }
             }
@@ -665,9 +725,20 @@ struct AVProducer::Impl
                 buffer_eof_ = (video_filter_.eof && audio_filter_.eof) || time > end;
 
                 if (buffer_eof_) {
+                    {
+                        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+                        buffer_cond_.notify_all();
+                    }
+
                     if (loop_ && frame_count_ > 2) {
+                        // A clip shorter than the head is looped from it entirely.
+                        if (!loop_head_.empty() && loop_head_.back().pts == frame.pts) {
+                            loop_head_complete_ = true;
+                        }
                         frame = Frame{};
-                        seek_internal(start);
+                        if (!loop_from_head(start, frame)) {
+                            seek_internal(start);
+                        }
                     } else {
                         boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
                     }
@@ -736,10 +807,18 @@ struct AVProducer::Impl
 
             {
                 boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
-                buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_ || abort_request_; });
-                if (seek_ == AV_NOPTS_VALUE) {
-                    buffer_.push_back(frame);
+
+                // Frames before a scrub target are only decoded to fill the cache.
+                if (cache_only_until_ == AV_NOPTS_VALUE || frame.pts + frame.duration > cache_only_until_) {
+                    buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_ || abort_request_; });
+                    if (seek_ == AV_NOPTS_VALUE) {
+                        buffer_.push_back(frame);
+                        buffer_cond_.notify_all();
+                        capture_loop_head(frame, start_ != AV_NOPTS_VALUE ? start_.load() : 0);
+                    }
                 }
+
+                cache_frame(frame, buffer_.empty() ? frame.pts : buffer_.front().pts);
             }
 
             frame_count_ += 1;
@@ -795,10 +874,12 @@ struct AVProducer::Impl
                 } else if (frame_time_ < end) {
                     frame_time_ = input_duration_;
                 }
+                frame_eof_ = true;
                 return core::draw_frame::still(frame_);
             }
             graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
             latency_ += 1;
+            frame_eof_ = false;
             return core::draw_frame{};
         }
 
@@ -811,6 +892,7 @@ struct AVProducer::Impl
         frame_time_     = buffer_[0].pts;
         frame_duration_ = buffer_[0].duration;
         frame_flush_    = false;
+        frame_eof_      = false;
 
         buffer_.pop_front();
         buffer_cond_.notify_all();
@@ -834,6 +916,20 @@ struct AVProducer::Impl
         }
     }
 
+    bool eof() const
+    {
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        return frame_eof_;
+    }
+
+    bool wait_frame(std::chrono::milliseconds timeout)
+    {
+        boost::unique_lock<boost::mutex> lock(buffer_mutex_);
+        return buffer_cond_.wait_for(lock, boost::chrono::milliseconds(timeout.count()), [&] {
+            return !buffer_.empty() || buffer_eof_ || abort_request_;
+        });
+    }
+
     int64_t time() const
     {
         if (frame_time_ == AV_NOPTS_VALUE) {
@@ -960,26 +1056,223 @@ struct AVProducer::Impl
         return result;
     }
 
-    void seek_internal(int64_t time)
+    void cache_frame(Frame frame, int64_t playhead)
+    {
+        if (scrub_cache_capacity_ == 0 || frame.pts == AV_NOPTS_VALUE) {
+            return;
+        }
+
+        // What is cached has already been made into a draw_frame.
+        frame.video = nullptr;
+        frame.audio = nullptr;
+
+        scrub_cache_[frame.pts] = std::move(frame);
+
+        while (scrub_cache_.size() > scrub_cache_capacity_) {
+            const auto first = scrub_cache_.begin();
+            const auto last  = std::prev(scrub_cache_.end());
+            scrub_cache_.erase(playhead - first->first > last->first - playhead ? first : last);
+        }
+    }
+
+    // Serves a seek from the scrub cache. The cached frames from time on go straight to the buffer and decoding
+    // continues after them.
+    bool seek_cached(int64_t time, Frame& last)
+    {
+        auto it = scrub_cache_.upper_bound(time);
+        if (it == scrub_cache_.begin()) {
+            return false;
+        }
+        --it;
+        if (time >= it->first + it->second.duration) {
+            return false;
+        }
+
+        auto count = 0;
+        {
+            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+
+            // A newer seek has cleared the buffer and will be served next.
+            if (seek_ != AV_NOPTS_VALUE) {
+                return true;
+            }
+
+            for (; it != scrub_cache_.end() && count < buffer_capacity_; ++it, ++count) {
+                if (count > 0 && std::abs(it->first - (last.pts + last.duration)) > last.duration / 2) {
+                    break;
+                }
+                buffer_.push_back(it->second);
+                last = it->second;
+            }
+            buffer_cond_.notify_all();
+        }
+
+        seek_internal(last.pts + last.duration);
+        frame_count_ = count;
+
+        return true;
+    }
+
+    void capture_loop_head(Frame frame, int64_t start)
+    {
+        if (!loop_ || frame.pts == AV_NOPTS_VALUE) {
+            return;
+        }
+
+        if (loop_head_start_ != start) {
+            loop_head_.clear();
+            loop_head_start_    = start;
+            loop_head_complete_ = false;
+        }
+
+        if (loop_head_complete_) {
+            return;
+        }
+
+        if (!loop_head_.empty()) {
+            const auto& last = loop_head_.back();
+            if (std::abs(frame.pts - (last.pts + last.duration)) > last.duration / 2) {
+                loop_head_.clear();
+            }
+        }
+
+        if (loop_head_.empty() && std::abs(frame.pts - start) > frame.duration / 2) {
+            return;
+        }
+
+        frame.video = nullptr;
+        frame.audio = nullptr;
+
+        loop_head_.push_back(std::move(frame));
+        loop_head_complete_ = static_cast<int>(loop_head_.size()) >= buffer_capacity_;
+    }
+
+    // Starts the next pass of a loop with the cached head, right behind the end of the previous pass, while the
+    // decoders restart after it.
+    bool loop_from_head(int64_t start, Frame& last)
+    {
+        if (!loop_head_complete_ || loop_head_start_ != start) {
+            return false;
+        }
+
+        auto count = 0;
+        {
+            boost::unique_lock<boost::mutex> lock(buffer_mutex_);
+
+            for (auto& frame : loop_head_) {
+                buffer_cond_.wait(lock, [&] {
+                    return buffer_.size() < buffer_capacity_ || abort_request_ || seek_ != AV_NOPTS_VALUE;
+                });
+
+                // A seek will be served next instead.
+                if (abort_request_ || seek_ != AV_NOPTS_VALUE) {
+                    return true;
+                }
+
+                buffer_.push_back(frame);
+                last = frame;
+                count += 1;
+            }
+        }
+
+        seek_internal(last.pts + last.duration, false);
+        frame_count_ = count;
+
+        return true;
+    }
+
+    // Where to decode from to reach time. With the cache enabled that is the keyframe before it, so that the whole
+    // GOP is cached and stepping backwards through it needs no more decoding.
+    int64_t scrub_start(int64_t time) const
+    {
+        if (scrub_cache_capacity_ == 0 || !keyframes_) {
+            return time;
+        }
+
+        const auto start_time = input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0;
+        const auto keyframe   = keyframes_->before(time + start_time);
+        if (keyframe == AV_NOPTS_VALUE) {
+            return time;
+        }
+
+        const auto frames = (time + start_time - keyframe) / av_rescale_q(1, format_tb_, TIME_BASE_Q);
+        return frames > 0 && static_cast<std::size_t>(frames) < scrub_cache_capacity_ / 2 ? keyframe - start_time
+                                                                                          : time;
+    }
+
+    // Where a decoder continues feeding the filters from, or AV_NOPTS_VALUE if it cannot.
+    static int64_t feed_position(const Decoder& decoder)
+    {
+        if (decoder.eof) {
+            return AV_NOPTS_VALUE;
+        }
+
+        const auto pts = decoder.frame ? decoder.frame->pts : decoder.next_pts;
+        return pts != AV_NOPTS_VALUE ? av_rescale_q(pts, decoder.st->time_base, TIME_BASE_Q) : AV_NOPTS_VALUE;
+    }
+
+    // Whether decoding can go on forward to time instead of seeking. The filters are rebuilt for the new target, so
+    // what every decoder, audio included, has fed them so far must be before it. Without a keyframe between where
+    // video decoding is and the target, jumping would only mean decoding again from an earlier keyframe.
+    bool can_decode_to(int64_t time, int64_t keyframe) const
+    {
+        if (input_.eof() || keyframe == AV_NOPTS_VALUE) {
+            return false;
+        }
+
+        auto has_video = false;
+        for (auto& p : decoders_) {
+            const auto position = feed_position(p.second);
+            if (position == AV_NOPTS_VALUE || position > time) {
+                return false;
+            }
+            if (p.second.ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+                if (keyframe > position) {
+                    return false;
+                }
+                has_video = true;
+            }
+        }
+
+        return has_video;
+    }
+
+    void seek_internal(int64_t time, bool flush = true)
     {
         time = time != AV_NOPTS_VALUE ? time : 0;
         time = time + (input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
 
-        // TODO (fix) Dont seek if time is close future.
-        input_.seek(time);
-        frame_flush_ = true;
-        frame_count_ = 0;
-        buffer_eof_  = false;
+        if (!keyframes_) {
+            keyframes_ = find_keyframe_index(path_);
+        }
+
+        const auto keyframe = keyframes_ ? keyframes_->before(time) : AV_NOPTS_VALUE;
 
-        decoders_.clear();
+        if (!can_decode_to(time, keyframe)) {
+            input_.seek(keyframe != AV_NOPTS_VALUE ? keyframe : time);
+            decoders_.clear();
+        }
+
+        frame_flush_      = frame_flush_ || flush;
+        frame_count_      = 0;
+        buffer_eof_       = false;
+        cache_only_until_ = AV_NOPTS_VALUE;
 
         reset(time);
+
+        // The filters drop what is before the target. Allow for the frame before it, which they may still show.
+        const auto preroll_end = time - 2 * av_rescale_q(1, format_tb_, TIME_BASE_Q);
+        for (auto& p : decoders_) {
+            p.second.preroll_end = av_rescale_q(preroll_end, TIME_BASE_Q, p.second.st->time_base);
+        }
     }
 
     void reset(int64_t start_time)
     {
-        video_filter_ = Filter(vfilter_, input_, decoders_, start_time, AVMEDIA_TYPE_VIDEO, format_desc_);
-        audio_filter_ = Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_);
+        video_filter_ =
+            Filter(vfilter_, input_, decoders_, start_time, AVMEDIA_TYPE_VIDEO, format_desc_, this, frame_factory_);
+        audio_filter_ =
+            Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_, this, frame_factory_);
 
         sources_.clear();
         for (auto& p : video_filter_.sources) {
@@ -1002,6 +1295,16 @@ struct AVProducer::Impl
         }
     }
 
+    std::size_t footprint() const
+    {
+        // An idle producer fills the output buffer, the loop head while looping and the scrub cache. The video decoder
+        // holds about a frame per thread, and the filters and the decoder references a few more.
+        const auto threads = std::max(1, env::properties().get(L"configuration.ffmpeg.producer.threads", 4));
+        const auto frames  = static_cast<std::size_t>(buffer_capacity_) * (loop_ ? 2 : 1) + scrub_cache_capacity_ +
+                            static_cast<std::size_t>(threads + 2);
+        return input_.readahead_capacity() + frames * format_desc_.size;
+    }
+
     std::string print() const
     {
         const int position = std::max(static_cast<int>(time() - start().value_or(0)), 0);
@@ -1060,6 +1363,10 @@ AVProducer& AVProducer::start(int64_t start)
 
 int64_t AVProducer::time() const { return impl_->time(); }
 
+bool AVProducer::wait_frame(std::chrono::milliseconds timeout) const { return impl_->wait_frame(timeout); }
+
+bool AVProducer::eof() const { return impl_->eof(); }
+
 int64_t AVProducer::start() const { return impl_->start().value_or(0); }
 
 AVProducer& AVProducer::duration(int64_t duration)
@@ -1076,4 +1383,6 @@ core::monitor::state AVProducer::state() const
     return impl_->state_;
 }
 
+std::size_t AVProducer::footprint() const { return impl_->footprint(); }
+
 }} // namespace caspar::ffmpeg
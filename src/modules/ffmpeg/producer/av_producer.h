@@ -6,6 +6,7 @@
 
 #include <boost/optional.hpp>
 
+#include <chrono>
 #include <memory>
 #include <string>
 
@@ -30,6 +31,12 @@ class AVProducer
     AVProducer& seek(int64_t time);
     int64_t     time() const;
 
+    // Waits at most timeout for next_frame() to have a frame or to hold the final frame. Returns false on timeout.
+    bool wait_frame(std::chrono::milliseconds timeout) const;
+
+    // Whether the last next_frame() held the final frame because the clip had ended.
+    bool eof() const;
+
     AVProducer& loop(bool loop);
     bool        loop() const;
 
@@ -41,6 +48,10 @@ class AVProducer
 
     caspar::core::monitor::state state() const;
 
+    // Estimate of the memory held in bytes, counting the readahead buffer and the decoded frames that are buffered,
+    // cached or in flight in the decoders and filters.
+    std::size_t footprint() const;
+
   private:
     struct Impl;
     std::shared_ptr<Impl> impl_;
@@ -0,0 +1,365 @@
+#include "av_readahead.h"
+
+#include "../util/av_assert.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/scope_exit.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+const std::size_t READAHEAD_CHUNK_SIZE   = 1024 * 1024;
+const std::size_t READAHEAD_MAX_CAPACITY = 256 * 1024 * 1024;
+const int         CONTEXT_BUFFER_SIZE    = 64 * 1024;
+
+struct Readahead::Impl
+{
+    std::shared_ptr<diagnostics::graph> graph_;
+    const AVIOInterruptCB               interrupt_;
+    const double                        duration_;
+
+    std::shared_ptr<AVIOContext> file_;
+    std::shared_ptr<AVIOContext> context_;
+    int64_t                      size_ = -1;
+
+    // The buffer is a ring holding the file from base_ to base_ + valid_. The demuxer reads from pos_, and what it
+    // has read is kept until the space is needed, so that short seeks backwards do not go to the file again.
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    std::vector<uint8_t>    buffer_;
+    std::size_t             begin_      = 0;
+    std::size_t             valid_      = 0;
+    int64_t                 base_       = 0;
+    int64_t                 pos_        = 0;
+    int64_t                 generation_ = 0;
+    bool                    eof_        = false;
+    int                     error_      = 0;
+    bool                    primed_     = false;
+    int64_t                 byte_rate_  = 0;
+    double                  read_rate_  = 0.0;
+
+    std::atomic<bool> abort_{false};
+    std::thread       thread_;
+
+    Impl(const std::string& filename, const AVIOInterruptCB& interrupt, std::shared_ptr<diagnostics::graph> graph)
+        : graph_(std::move(graph))
+        , interrupt_(interrupt)
+        , duration_(env::properties().get(L"configuration.ffmpeg.producer.readahead-duration", 2.0))
+        , buffer_(static_cast<std::size_t>(env::properties().get(L"configuration.ffmpeg.producer.readahead-size", 16)) *
+                  1024 * 1024)
+    {
+        graph_->set_color("readahead", diagnostics::color(0.3f, 0.6f, 0.9f));
+        graph_->set_color("readahead-rate", diagnostics::color(0.6f, 0.8f, 1.0f));
+        graph_->set_color("readahead-stall", diagnostics::color(0.9f, 0.3f, 0.3f));
+
+        AVDictionary* options = nullptr;
+        CASPAR_SCOPE_EXIT { av_dict_free(&options); };
+        FF(av_dict_set(&options, "rw_timeout", "60000000", 0)); // 60 second IO timeout
+
+        const AVIOInterruptCB file_interrupt = {Impl::interrupt_cb, this};
+
+        AVIOContext* file = nullptr;
+        FF(avio_open2(&file, filename.c_str(), AVIO_FLAG_READ, &file_interrupt, &options));
+        file_ = std::shared_ptr<AVIOContext>(file, [](AVIOContext* ptr) { avio_closep(&ptr); });
+        size_ = avio_size(file);
+
+        auto context_buffer = static_cast<unsigned char*>(av_malloc(CONTEXT_BUFFER_SIZE));
+        if (!context_buffer) {
+            FF_RET(AVERROR(ENOMEM), "av_malloc");
+        }
+
+        auto context =
+            avio_alloc_context(context_buffer, CONTEXT_BUFFER_SIZE, 0, this, Impl::read_cb, nullptr, Impl::seek_cb);
+        if (!context) {
+            av_free(context_buffer);
+            FF_RET(AVERROR(ENOMEM), "avio_alloc_context");
+        }
+        context_ = std::shared_ptr<AVIOContext>(context, [](AVIOContext* ptr) {
+            av_freep(&ptr->buffer);
+            avio_context_free(&ptr);
+        });
+
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~Impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    static int interrupt_cb(void* opaque)
+    {
+        auto self = static_cast<Impl*>(opaque);
+        if (self->abort_) {
+            return 1;
+        }
+        return self->interrupt_.callback ? self->interrupt_.callback(self->interrupt_.opaque) : 0;
+    }
+
+    static int read_cb(void* opaque, uint8_t* buf, int size) { return static_cast<Impl*>(opaque)->read(buf, size); }
+
+    static int64_t seek_cb(void* opaque, int64_t offset, int whence)
+    {
+        return static_cast<Impl*>(opaque)->seek(offset, whence);
+    }
+
+    std::size_t ahead() const { return static_cast<std::size_t>(base_ + static_cast<int64_t>(valid_) - pos_); }
+
+    void update_graph() { graph_->set_value("readahead", static_cast<double>(ahead()) / buffer_.size()); }
+
+    int read(uint8_t* buf, int size)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        while (ahead() == 0 && !eof_ && error_ == 0) {
+            if (interrupt_.callback && interrupt_.callback(interrupt_.opaque)) {
+                return AVERROR_EXIT;
+            }
+            if (primed_) {
+                // The demuxer caught up with the reads, as opposed to waiting for them after opening or seeking.
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "readahead-stall");
+                primed_ = false;
+            }
+            cond_.wait_for(lock, std::chrono::milliseconds(20));
+        }
+
+        if (ahead() == 0) {
+            return error_ != 0 ? error_ : AVERROR_EOF;
+        }
+
+        const auto count  = std::min(static_cast<std::size_t>(size), ahead());
+        const auto offset = (begin_ + static_cast<std::size_t>(pos_ - base_)) % buffer_.size();
+        const auto first  = std::min(count, buffer_.size() - offset);
+
+        std::memcpy(buf, buffer_.data() + offset, first);
+        std::memcpy(buf + first, buffer_.data(), count - first);
+
+        pos_ += count;
+        primed_ = true;
+        update_graph();
+        cond_.notify_all();
+
+        return static_cast<int>(count);
+    }
+
+    int64_t seek(int64_t offset, int whence)
+    {
+        if (whence & AVSEEK_SIZE) {
+            return size_ >= 0 ? size_ : AVERROR(ENOSYS);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        switch (whence & ~AVSEEK_FORCE) {
+            case SEEK_SET:
+                break;
+            case SEEK_CUR:
+                offset += pos_;
+                break;
+            case SEEK_END:
+                if (size_ < 0) {
+                    return AVERROR(ENOSYS);
+                }
+                offset += size_;
+                break;
+            default:
+                return AVERROR(EINVAL);
+        }
+
+        if (offset < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        if (offset < base_ || offset > base_ + static_cast<int64_t>(valid_)) {
+            begin_ = 0;
+            valid_ = 0;
+            base_  = offset;
+            eof_   = false;
+            error_ = 0;
+            generation_ += 1;
+        }
+
+        pos_    = offset;
+        primed_ = false;
+        update_graph();
+        cond_.notify_all();
+
+        return offset;
+    }
+
+    void set_byte_rate(int64_t byte_rate)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        byte_rate_ = byte_rate;
+
+        const auto capacity = std::min(static_cast<std::size_t>(byte_rate * duration_), READAHEAD_MAX_CAPACITY);
+        if (capacity <= buffer_.size()) {
+            return;
+        }
+
+        std::vector<uint8_t> buffer(capacity);
+        const auto           first = std::min(valid_, buffer_.size() - begin_);
+        std::memcpy(buffer.data(), buffer_.data() + begin_, first);
+        std::memcpy(buffer.data() + first, buffer_.data(), valid_ - first);
+
+        buffer_ = std::move(buffer);
+        begin_  = 0;
+        cond_.notify_all();
+    }
+
+    void run()
+    {
+        set_thread_name(L"[ffmpeg::av_producer::Readahead]");
+
+        std::vector<uint8_t> chunk(READAHEAD_CHUNK_SIZE);
+        int64_t              file_pos = 0;
+
+        while (true) {
+            int64_t     offset;
+            int64_t     generation;
+            std::size_t count;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return abort_ || (!eof_ && error_ == 0 && ahead() < buffer_.size()); });
+
+                if (abort_) {
+                    return;
+                }
+
+                offset     = base_ + static_cast<int64_t>(valid_);
+                generation = generation_;
+                count      = std::min(chunk.size(), buffer_.size() - ahead());
+            }
+
+            int ret = 0;
+            if (offset != file_pos) {
+                const auto pos = avio_seek(file_.get(), offset, SEEK_SET);
+                ret            = pos < 0 ? static_cast<int>(pos) : 0;
+            }
+
+            caspar::timer timer;
+            if (ret == 0) {
+                ret = avio_read(file_.get(), chunk.data(), static_cast<int>(count));
+            }
+            const auto elapsed = timer.elapsed();
+
+            file_pos = ret > 0 ? offset + ret : -1;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (abort_) {
+                return;
+            }
+
+            if (generation != generation_) {
+                continue;
+            }
+
+            if (ret == 0 || ret == AVERROR_EOF) {
+                eof_ = true;
+            } else if (ret < 0) {
+                error_ = ret;
+            } else {
+                append(chunk.data(), static_cast<std::size_t>(ret));
+
+                if (elapsed > 0.0) {
+                    read_rate_ = read_rate_ > 0.0 ? read_rate_ * 0.8 + ret / elapsed * 0.2 : ret / elapsed;
+                }
+                if (byte_rate_ > 0) {
+                    // 0.5 is reading as fast as the clip plays.
+                    graph_->set_value("readahead-rate", std::min(1.0, read_rate_ / byte_rate_ * 0.5));
+                }
+            }
+
+            update_graph();
+            cond_.notify_all();
+        }
+    }
+
+    void append(const uint8_t* data, std::size_t count)
+    {
+        // Data ahead of pos_ is never dropped. After a seek backwards within the buffer while the chunk was read,
+        // there is less room than the chunk was sized for, and the rest of it is read again later.
+        count = std::min(count, buffer_.size() - ahead());
+
+        // Make room by dropping what has already been read.
+        if (valid_ + count > buffer_.size()) {
+            const auto drop = valid_ + count - buffer_.size();
+            begin_          = (begin_ + drop) % buffer_.size();
+            valid_ -= drop;
+            base_ += drop;
+        }
+
+        const auto offset = (begin_ + valid_) % buffer_.size();
+        const auto first  = std::min(count, buffer_.size() - offset);
+
+        std::memcpy(buffer_.data() + offset, data, first);
+        std::memcpy(buffer_.data(), data + first, count - first);
+
+        valid_ += count;
+    }
+};
+
+Readahead::Readahead(const std::string&                  filename,
+                     const AVIOInterruptCB&              interrupt,
+                     std::shared_ptr<diagnostics::graph> graph)
+    : impl_(new Impl(filename, interrupt, std::move(graph)))
+{
+}
+
+Readahead::~Readahead() {}
+
+AVIOContext* Readahead::context() { return impl_->context_.get(); }
+
+void Readahead::set_byte_rate(int64_t byte_rate) { impl_->set_byte_rate(byte_rate); }
+
+std::size_t Readahead::capacity() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->buffer_.size();
+}
+
+bool Readahead::enabled(const std::string& filename)
+{
+    if (env::properties().get(L"configuration.ffmpeg.producer.readahead-size", 16) <= 0) {
+        return false;
+    }
+
+    const auto protocol = protocol_split(u16(filename)).first;
+    return protocol.empty() || protocol == L"file";
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <common/diagnostics/graph.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct AVIOContext;
+struct AVIOInterruptCB;
+
+namespace caspar { namespace ffmpeg {
+
+// An AVIOContext reading a file through a large buffer, kept filled ahead of the demuxer by a dedicated thread using
+// large sequential reads. Smooths over stalls on network storage.
+class Readahead
+{
+  public:
+    Readahead(const std::string&                  filename,
+              const AVIOInterruptCB&              interrupt,
+              std::shared_ptr<diagnostics::graph> graph);
+    ~Readahead();
+
+    AVIOContext* context();
+
+    // Grows the buffer to hold the configured duration at this rate, once it is known.
+    void set_byte_rate(int64_t byte_rate);
+
+    // The size of the buffer in bytes.
+    std::size_t capacity() const;
+
+    static bool enabled(const std::string& filename);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+    Readahead(const Readahead&) = delete;
+    Readahead& operator=(const Readahead&) = delete;
+};
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "clip_cache.h"
+
+#include "av_producer.h"
+#include "ffmpeg_producer.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_visitor.h>
+#include <core/frame/pixel_format.h>
+#include <core/module_dependencies.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <protocol/amcp/AMCPCommand.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <future>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+struct cached_clip
+{
+    std::vector<core::draw_frame> frames;
+    std::size_t                   size = 0;
+};
+
+struct clip_key
+{
+    std::wstring format;
+    std::wstring path;
+    std::time_t  write_time;
+    std::wstring vfilter;
+    std::wstring afilter;
+
+    bool operator==(const clip_key& other) const
+    {
+        return format == other.format && path == other.path && write_time == other.write_time &&
+               vfilter == other.vfilter && afilter == other.afilter;
+    }
+};
+
+// Only local files are cached, streams and devices have no end to decode to.
+boost::optional<clip_key> make_key(const core::video_format_desc& format_desc,
+                                   const std::wstring&            filename,
+                                   const std::wstring&            vfilter,
+                                   const std::wstring&            afilter)
+{
+    if (boost::contains(filename, L"://")) {
+        return boost::none;
+    }
+
+    boost::system::error_code ec;
+    const auto                write_time = boost::filesystem::last_write_time(filename, ec);
+    if (ec) {
+        return boost::none;
+    }
+
+    return clip_key{format_desc.name, filename, write_time, vfilter, afilter};
+}
+
+// Bytes of image and audio data held by a frame. A frame committed by a GPU accelerator also holds its planes as
+// textures for as long as it lives, and those count as much again.
+struct frame_size_visitor : public core::frame_visitor
+{
+    std::size_t size = 0;
+
+    void push(const core::frame_transform& transform) override {}
+
+    void visit(const core::const_frame& frame) override
+    {
+        std::size_t image_size = 0;
+        for (std::size_t n = 0; n < frame.pixel_format_desc().planes.size(); ++n) {
+            image_size += frame.image_data(n).size();
+        }
+        size += frame.opaque().empty() ? image_size : image_size * 2;
+        size += frame.audio_data().size() * sizeof(std::int32_t);
+    }
+
+    void pop() override {}
+};
+
+class clip_cache
+{
+    struct entry
+    {
+        clip_key                           key;
+        std::shared_ptr<const cached_clip> clip;
+    };
+
+    struct job
+    {
+        clip_key                             key;
+        spl::shared_ptr<core::frame_factory> frame_factory;
+        core::video_format_desc              format_desc;
+        std::wstring                         name;
+    };
+
+    const std::size_t budget_ =
+        env::properties().get(L"configuration.ffmpeg.producer.clip-cache", static_cast<std::size_t>(0)) * 1024 * 1024;
+
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    std::list<entry>        entries_;
+    std::size_t             used_ = 0;
+    std::deque<job>         queue_;
+    std::atomic<bool>       abort_{false};
+    std::thread             thread_;
+
+    // Plays the clip through an AVProducer as fast as it decodes, keeping every frame.
+    std::shared_ptr<cached_clip> decode(const job& job)
+    {
+        AVProducer producer(job.frame_factory,
+                            job.format_desc,
+                            u8(job.name),
+                            u8(job.key.path),
+                            u8(job.key.vfilter),
+                            u8(job.key.afilter),
+                            boost::none,
+                            boost::none,
+                            false);
+
+        auto clip = std::make_shared<cached_clip>();
+        while (!abort_) {
+            auto frame = producer.next_frame();
+            if (producer.eof()) {
+                return clip;
+            }
+
+            if (!frame) {
+                producer.wait_frame(std::chrono::milliseconds(100));
+                continue;
+            }
+
+            frame_size_visitor visitor;
+            frame.accept(visitor);
+            clip->size += visitor.size;
+
+            if (clip->size > budget_) {
+                CASPAR_LOG(warning) << L"[ffmpeg] " << job.name << L" does not fit in the clip cache.";
+                return nullptr;
+            }
+
+            clip->frames.push_back(std::move(frame));
+        }
+        return nullptr;
+    }
+
+    void run()
+    {
+        set_thread_name(L"[ffmpeg::clip_cache]");
+
+        while (true) {
+            boost::optional<job> next;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return abort_ || !queue_.empty(); });
+                if (abort_) {
+                    return;
+                }
+                next = queue_.front();
+            }
+
+            std::shared_ptr<cached_clip> clip;
+            try {
+                clip = decode(*next);
+                if (clip && !clip->frames.empty()) {
+                    CASPAR_LOG(info) << L"[ffmpeg] Cached " << clip->frames.size() << L" frames of " << next->name
+                                     << L" (" << clip->size / (1024 * 1024) << L" MB)";
+                }
+            } catch (...) {
+                if (!abort_) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+
+            // Clips are released outside of the lock.
+            std::vector<std::shared_ptr<const cached_clip>> evicted;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queue_.pop_front();
+
+                if (!clip || clip->frames.empty() || abort_) {
+                    continue;
+                }
+
+                entries_.push_front(entry{next->key, std::move(clip)});
+                used_ += entries_.front().clip->size;
+
+                while (used_ > budget_) {
+                    used_ -= entries_.back().clip->size;
+                    evicted.push_back(std::move(entries_.back().clip));
+                    entries_.pop_back();
+                }
+            }
+        }
+    }
+
+  public:
+    static clip_cache& instance()
+    {
+        static clip_cache cache;
+        return cache;
+    }
+
+    ~clip_cache() { clear(); }
+
+    std::shared_ptr<const cached_clip> find(const clip_key& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = std::find_if(entries_.begin(), entries_.end(), [&](const entry& e) { return e.key == key; });
+        if (it == entries_.end()) {
+            return nullptr;
+        }
+
+        entries_.splice(entries_.begin(), entries_, it);
+        return it->clip;
+    }
+
+    bool admit(clip_key                             key,
+               spl::shared_ptr<core::frame_factory> frame_factory,
+               core::video_format_desc              format_desc,
+               std::wstring                         name)
+    {
+        if (budget_ == 0) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (abort_) {
+            return false;
+        }
+
+        const auto cached = std::any_of(entries_.begin(), entries_.end(), [&](const entry& e) { return e.key == key; });
+        const auto queued = std::any_of(queue_.begin(), queue_.end(), [&](const job& j) { return j.key == key; });
+        if (cached || queued) {
+            return true;
+        }
+
+        queue_.push_back(job{std::move(key), std::move(frame_factory), std::move(format_desc), std::move(name)});
+        if (!thread_.joinable()) {
+            thread_ = std::thread([this] { run(); });
+        }
+        cond_.notify_one();
+
+        return true;
+    }
+
+    void clear()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        std::list<entry> entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries.swap(entries_);
+            queue_.clear();
+            used_ = 0;
+        }
+    }
+};
+
+// Plays a cached clip by indexing its frames, the clip is kept alive for as long as the producer plays it even if it
+// is evicted in the meantime.
+struct cached_producer : public core::frame_producer
+{
+    const std::shared_ptr<const cached_clip> clip_;
+    const core::video_format_desc            format_desc_;
+    const std::wstring                       filename_;
+
+    mutable std::mutex   mutex_;
+    int64_t              start_;
+    int64_t              duration_;
+    bool                 loop_;
+    int64_t              time_;
+    core::draw_frame     frame_;
+    core::monitor::state state_;
+
+  public:
+    cached_producer(std::shared_ptr<const cached_clip> clip,
+                    core::video_format_desc            format_desc,
+                    std::wstring                       filename,
+                    boost::optional<int64_t>           start,
+                    boost::optional<int64_t>           duration,
+                    bool                               loop)
+        : clip_(std::move(clip))
+        , format_desc_(std::move(format_desc))
+        , filename_(std::move(filename))
+        , start_(start.value_or(0))
+        , duration_(duration.value_or(std::numeric_limits<int64_t>::max()))
+        , loop_(loop)
+        , time_(start_)
+    {
+        state_["file/path"] = u8(filename_);
+        update_state();
+    }
+
+    int64_t end() const
+    {
+        const auto size = static_cast<int64_t>(clip_->frames.size());
+        return duration_ < size - start_ ? start_ + duration_ : size;
+    }
+
+    void update_state()
+    {
+        const auto length   = static_cast<int64_t>(clip_->frames.size());
+        state_["file/clip"] = {start_ / format_desc_.fps, (end() - start_) / format_desc_.fps};
+        state_["file/time"] = {time_ / format_desc_.fps, length / format_desc_.fps};
+        state_["loop"]      = loop_;
+    }
+
+    // frame_producer
+
+    core::draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!frame_ && !clip_->frames.empty()) {
+            frame_ = clip_->frames[std::max<int64_t>(0, std::min(time_, end() - 1))];
+        }
+        return core::draw_frame::still(frame_);
+    }
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (time_ >= end() || time_ < 0) {
+            if (!loop_ || start_ >= end()) {
+                return core::draw_frame::still(frame_);
+            }
+            time_ = start_;
+        }
+
+        frame_ = clip_->frames[time_++];
+        update_state();
+
+        return frame_;
+    }
+
+    std::uint32_t frame_number() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<std::uint32_t>(std::max<int64_t>(0, time_ - start_));
+    }
+
+    std::uint32_t nb_frames() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loop_ ? std::numeric_limits<std::uint32_t>::max()
+                     : static_cast<std::uint32_t>(std::max<int64_t>(0, end() - start_));
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::wstring result;
+
+        std::wstring cmd = params.at(0);
+        std::wstring value;
+        if (params.size() > 1) {
+            value = params.at(1);
+        }
+
+        if (boost::iequals(cmd, L"loop")) {
+            if (!value.empty()) {
+                loop_ = boost::lexical_cast<bool>(value);
+            }
+
+            result = std::to_wstring(loop_);
+        } else if (boost::iequals(cmd, L"in") || boost::iequals(cmd, L"start")) {
+            if (!value.empty()) {
+                start_ = boost::lexical_cast<int64_t>(value);
+            }
+
+            result = std::to_wstring(start_);
+        } else if (boost::iequals(cmd, L"out")) {
+            if (!value.empty()) {
+                duration_ = boost::lexical_cast<int64_t>(value) - start_;
+            }
+
+            result = std::to_wstring(end());
+        } else if (boost::iequals(cmd, L"length")) {
+            if (!value.empty()) {
+                duration_ = boost::lexical_cast<std::int64_t>(value);
+            }
+
+            result = std::to_wstring(end() - start_);
+        } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            int64_t seek;
+            if (boost::iequals(value, L"rel")) {
+                seek = time_;
+            } else if (boost::iequals(value, L"in")) {
+                seek = start_;
+            } else if (boost::iequals(value, L"out")) {
+                seek = end();
+            } else if (boost::iequals(value, L"end")) {
+                seek = static_cast<int64_t>(clip_->frames.size());
+            } else {
+                seek = boost::lexical_cast<int64_t>(value);
+            }
+
+            if (params.size() > 2) {
+                seek += boost::lexical_cast<int64_t>(params.at(2));
+            }
+
+            seek   = std::max<int64_t>(0, std::min(seek, static_cast<int64_t>(clip_->frames.size())));
+            time_  = seek;
+            frame_ = core::draw_frame{};
+
+            result = std::to_wstring(seek);
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+
+        update_state();
+
+        std::promise<std::wstring> promise;
+        promise.set_value(result);
+        return promise.get_future();
+    }
+
+    std::wstring print() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return L"ffmpeg[" + filename_ + L"|cached|" + std::to_wstring(std::max<int64_t>(0, time_ - start_)) + L"/" +
+               std::to_wstring(end() - start_) + L"]";
+    }
+
+    std::wstring name() const override { return L"ffmpeg"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+// PRELOAD [video_channel:int] [clip:string] {[VF filter:string]} {[AF filter:string]}
+std::wstring preload_command(protocol::amcp::command_context& ctx)
+{
+    const auto& channel = ctx.channel.channel;
+    if (!preload_producer(channel->frame_factory(), channel->video_format_desc(), ctx.parameters)) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Clip cache is disabled or can not cache " +
+                                                         ctx.parameters.at(0)));
+    }
+    return L"202 PRELOAD OK\r\n";
+}
+
+} // namespace
+
+std::shared_ptr<core::frame_producer> create_cached_producer(const core::video_format_desc& format_desc,
+                                                             const std::wstring&            filename,
+                                                             const std::wstring&            vfilter,
+                                                             const std::wstring&            afilter,
+                                                             boost::optional<int64_t>       start,
+                                                             boost::optional<int64_t>       duration,
+                                                             bool                           loop)
+{
+    const auto key = make_key(format_desc, filename, vfilter, afilter);
+    if (!key) {
+        return nullptr;
+    }
+
+    auto clip = clip_cache::instance().find(*key);
+    if (!clip) {
+        return nullptr;
+    }
+
+    return core::create_destroy_proxy(
+        spl::make_shared<cached_producer>(std::move(clip), format_desc, filename, start, duration, loop));
+}
+
+bool cache_clip(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                const core::video_format_desc&              format_desc,
+                const std::wstring&                         name,
+                const std::wstring&                         filename,
+                const std::wstring&                         vfilter,
+                const std::wstring&                         afilter)
+{
+    auto key = make_key(format_desc, filename, vfilter, afilter);
+    if (!key) {
+        return false;
+    }
+
+    return clip_cache::instance().admit(std::move(*key), frame_factory, format_desc, name);
+}
+
+void init_clip_cache(const core::module_dependencies& dependencies)
+{
+    dependencies.command_repository->register_channel_command(L"Basic Commands", L"PRELOAD", preload_command, 1);
+}
+
+void uninit_clip_cache() { clip_cache::instance().clear(); }
+
+}} // namespace caspar::ffmpeg
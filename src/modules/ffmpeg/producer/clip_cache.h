@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// Decoded clips are kept whole in memory, shared by every layer and channel of the same video format, so that
+// playing them again costs no decoding. Clips are only cached when asked to, either with the CACHE parameter of a
+// LOAD or through PRELOAD, and the least recently played are evicted once the decoded frames exceed
+// ffmpeg.producer.clip-cache (megabytes, 0 disables the cache).
+
+// A producer playing the cached clip of filename, or nullptr if it is not cached yet.
+std::shared_ptr<core::frame_producer> create_cached_producer(const core::video_format_desc& format_desc,
+                                                             const std::wstring&            filename,
+                                                             const std::wstring&            vfilter,
+                                                             const std::wstring&            afilter,
+                                                             boost::optional<int64_t>       start,
+                                                             boost::optional<int64_t>       duration,
+                                                             bool                           loop);
+
+// Decodes the clip of filename into the cache in the background. Returns false if the cache is disabled or the clip can
+// not be cached.
+bool cache_clip(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                const core::video_format_desc&              format_desc,
+                const std::wstring&                         name,
+                const std::wstring&                         filename,
+                const std::wstring&                         vfilter,
+                const std::wstring&                         afilter);
+
+// Registers the PRELOAD command.
+void init_clip_cache(const core::module_dependencies& dependencies);
+void uninit_clip_cache();
+
+}} // namespace caspar::ffmpeg
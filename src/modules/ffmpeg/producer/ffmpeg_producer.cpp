@@ -24,8 +24,10 @@
 #include "ffmpeg_producer.h"
 
 #include "av_producer.h"
+#include "clip_cache.h"
 
 #include <common/env.h>
+#include <common/except.h>
 #include <common/os/filesystem.h>
 #include <common/param.h>
 
@@ -39,6 +41,9 @@
 #include <boost/logic/tribool.hpp>
 
 #include <cstdint>
+#include <list>
+#include <mutex>
+#include <set>
 
 #pragma warning(push, 1)
 
@@ -54,12 +59,127 @@ namespace caspar { namespace ffmpeg {
 
 using namespace std::chrono_literals;
 
+void destroy_async(std::shared_ptr<AVProducer> producer)
+{
+    std::thread([producer = std::move(producer)]() mutable {
+        try {
+            producer.reset();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    })
+        .detach();
+}
+
+struct pool_key
+{
+    const core::frame_factory* frame_factory;
+    std::wstring               format;
+    std::wstring               path;
+    std::time_t                write_time;
+    std::wstring               vfilter;
+    std::wstring               afilter;
+    boost::optional<int64_t>   start;
+    boost::optional<int64_t>   duration;
+
+    bool operator==(const pool_key& other) const
+    {
+        return frame_factory == other.frame_factory && format == other.format && path == other.path &&
+               write_time == other.write_time && vfilter == other.vfilter && afilter == other.afilter &&
+               start == other.start && duration == other.duration;
+    }
+};
+
+// Keeps recently released AVProducer instances open, seeked to their in-point with a full buffer, so that
+// re-cueing the same clip skips opening, probing and prerolling. Least recently used instances are evicted
+// once the estimated buffer memory exceeds ffmpeg.producer.pool-budget (megabytes, 0 disables the pool).
+class producer_pool
+{
+    struct entry
+    {
+        pool_key                    key;
+        std::shared_ptr<AVProducer> producer;
+        std::size_t                 size;
+    };
+
+    std::mutex        mutex_;
+    std::list<entry>  entries_;
+    std::size_t       used_ = 0;
+    const std::size_t budget_ =
+        env::properties().get(L"configuration.ffmpeg.producer.pool-budget", static_cast<std::size_t>(0)) * 1024 *
+        1024;
+
+  public:
+    static producer_pool& instance()
+    {
+        static producer_pool pool;
+        return pool;
+    }
+
+    std::shared_ptr<AVProducer> take(const pool_key& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = std::find_if(entries_.begin(), entries_.end(), [&](const entry& e) { return e.key == key; });
+        if (it == entries_.end()) {
+            return nullptr;
+        }
+
+        auto producer = std::move(it->producer);
+        used_ -= it->size;
+        entries_.erase(it);
+        return producer;
+    }
+
+    void give(pool_key key, std::shared_ptr<AVProducer> producer)
+    {
+        // A pooled producer keeps reading and decoding until its buffers are full, so it is charged for all of them.
+        const auto size = producer->footprint();
+
+        if (size > budget_) {
+            destroy_async(std::move(producer));
+            return;
+        }
+
+        producer->seek(key.start.value_or(0));
+
+        std::vector<std::shared_ptr<AVProducer>> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            entries_.push_front(entry{std::move(key), std::move(producer), size});
+            used_ += size;
+
+            while (used_ > budget_) {
+                used_ -= entries_.back().size;
+                evicted.push_back(std::move(entries_.back().producer));
+                entries_.pop_back();
+            }
+        }
+
+        for (auto& p : evicted) {
+            destroy_async(std::move(p));
+        }
+    }
+
+    void clear()
+    {
+        std::list<entry> entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries.swap(entries_);
+            used_ = 0;
+        }
+    }
+};
+
 struct ffmpeg_producer : public core::frame_producer
 {
     const std::wstring                   filename_;
     spl::shared_ptr<core::frame_factory> frame_factory_;
     core::video_format_desc              format_desc_;
 
+    boost::optional<pool_key>   pool_key_;
     std::shared_ptr<AVProducer> producer_;
 
   public:
@@ -75,28 +195,44 @@ struct ffmpeg_producer : public core::frame_producer
         : filename_(filename)
         , frame_factory_(frame_factory)
         , format_desc_(format_desc)
-        , producer_(new AVProducer(frame_factory_,
-                                   format_desc_,
-                                   u8(path),
-                                   u8(filename),
-                                   u8(vfilter),
-                                   u8(afilter),
-                                   start,
-                                   duration,
-                                   loop))
     {
+        // Only local files are pooled, streams and devices can not be prerolled ahead of time.
+        if (!boost::contains(filename, L"://")) {
+            boost::system::error_code ec;
+            const auto write_time = boost::filesystem::last_write_time(filename, ec);
+            if (!ec) {
+                pool_key_ = pool_key{
+                    frame_factory_.get(), format_desc_.name, filename, write_time, vfilter, afilter, start, duration};
+                producer_ = producer_pool::instance().take(*pool_key_);
+            }
+        }
+
+        if (producer_) {
+            producer_->loop(loop.get_value_or(false));
+        } else {
+            producer_ = std::make_shared<AVProducer>(frame_factory_,
+                                                     format_desc_,
+                                                     u8(path),
+                                                     u8(filename),
+                                                     u8(vfilter),
+                                                     u8(afilter),
+                                                     start,
+                                                     duration,
+                                                     loop);
+        }
     }
 
     ~ffmpeg_producer()
     {
-        std::thread([producer = std::move(producer_)]() mutable {
+        if (pool_key_) {
             try {
-                producer.reset();
+                producer_pool::instance().give(std::move(*pool_key_), std::move(producer_));
+                return;
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
-        })
-            .detach();
+        }
+        destroy_async(std::move(producer_));
     }
 
     // frame_producer
@@ -135,18 +271,21 @@ struct ffmpeg_producer : public core::frame_producer
         } else if (boost::iequals(cmd, L"in") || boost::iequals(cmd, L"start")) {
             if (!value.empty()) {
                 producer_->start(boost::lexical_cast<int64_t>(value));
+                pool_key_.reset();
             }
 
             result = std::to_wstring(producer_->start());
         } else if (boost::iequals(cmd, L"out")) {
             if (!value.empty()) {
                 producer_->duration(boost::lexical_cast<int64_t>(value) - producer_->start());
+                pool_key_.reset();
             }
 
             result = std::to_wstring(producer_->start() + producer_->duration());
         } else if (boost::iequals(cmd, L"length")) {
             if (!value.empty()) {
                 producer_->duration(boost::lexical_cast<std::int64_t>(value));
+                pool_key_.reset();
             }
 
             result = std::to_wstring(producer_->duration());
@@ -192,6 +331,27 @@ struct ffmpeg_producer : public core::frame_producer
     core::monitor::state state() const override { return producer_->state(); }
 };
 
+const std::set<std::wstring>& supported_extensions()
+{
+    static const std::set<std::wstring> extensions = {L".m2t",
+                                                      L".mov",
+                                                      L".mp4",
+                                                      L".dv",
+                                                      L".flv",
+                                                      L".mpg",
+                                                      L".dnxhd",
+                                                      L".h264",
+                                                      L".prores",
+                                                      L".mkv",
+                                                      L".mxf",
+                                                      L".ts",
+                                                      L".mp3",
+                                                      L".wav",
+                                                      L".wma"};
+
+    return extensions;
+}
+
 boost::tribool has_valid_extension(const std::wstring& filename)
 {
     static const auto invalid_exts = {L".png",
@@ -210,25 +370,10 @@ boost::tribool has_valid_extension(const std::wstring& filename)
                                       L".ct",
                                       L".html",
                                       L".htm"};
-    static const auto valid_exts   = {L".m2t",
-                                    L".mov",
-                                    L".mp4",
-                                    L".dv",
-                                    L".flv",
-                                    L".mpg",
-                                    L".dnxhd",
-                                    L".h264",
-                                    L".prores",
-                                    L".mkv",
-                                    L".mxf",
-                                    L".ts",
-                                    L".mp3",
-                                    L".wav",
-                                    L".wma"};
 
     auto ext = boost::to_lower_copy(boost::filesystem::path(filename).extension().wstring());
 
-    if (std::find(valid_exts.begin(), valid_exts.end(), ext) != valid_exts.end()) {
+    if (supported_extensions().count(ext) > 0) {
         return boost::tribool(true);
     }
 
@@ -291,24 +436,27 @@ bool is_valid_file(const std::wstring& filename)
 
 std::wstring probe_stem(const std::wstring& stem)
 {
-    auto stem2  = boost::filesystem::path(stem);
-    auto parent = find_case_insensitive(stem2.parent_path().wstring());
-
-    if (!parent)
-        return L"";
-
-    auto dir = boost::filesystem::path(*parent);
-
-    for (auto it = boost::filesystem::directory_iterator(dir); it != boost::filesystem::directory_iterator(); ++it) {
-        if (boost::iequals(it->path().stem().wstring(), stem2.filename().wstring()) &&
-            is_valid_file(it->path().wstring()))
-            return it->path().wstring();
+    for (auto& file : find_case_insensitive_stem(stem)) {
+        if (is_valid_file(file))
+            return file;
     }
     return L"";
 }
 
-spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
-                                                      const std::vector<std::wstring>&         params)
+void clear_producer_pool() { producer_pool::instance().clear(); }
+
+struct clip_params
+{
+    std::wstring                  name;
+    std::wstring                  path;
+    std::wstring                  vfilter;
+    std::wstring                  afilter;
+    boost::optional<std::int64_t> start;
+    boost::optional<std::int64_t> duration;
+    bool                          loop;
+};
+
+boost::optional<clip_params> parse_clip_params(const std::vector<std::wstring>& params)
 {
     auto name = params.at(0);
     auto path = name;
@@ -323,11 +471,11 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
             name += boost::filesystem::path(path).extension().wstring();
         }
     } else if (!has_valid_extension(path) || has_invalid_protocol(path)) {
-        return core::frame_producer::empty();
+        return boost::none;
     }
 
     if (path.empty()) {
-        return core::frame_producer::empty();
+        return boost::none;
     }
 
     auto loop = contains_param(L"LOOP", params);
@@ -363,9 +511,48 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto vfilter = boost::to_lower_copy(get_param(L"VF", params, filter_str));
     auto afilter = boost::to_lower_copy(get_param(L"AF", params, get_param(L"FILTER", params, L"")));
 
+    return clip_params{name, path, vfilter, afilter, start, duration, loop};
+}
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    const auto clip = parse_clip_params(params);
+    if (!clip) {
+        return core::frame_producer::empty();
+    }
+
     try {
-        auto producer = spl::make_shared<ffmpeg_producer>(
-            dependencies.frame_factory, dependencies.format_desc, name, path, vfilter, afilter, start, duration, loop);
+        // CACHE admits the clip to the clip cache, this play still decodes it while the cache is filled.
+        if (contains_param(L"CACHE", params)) {
+            cache_clip(dependencies.frame_factory,
+                       dependencies.format_desc,
+                       clip->name,
+                       clip->path,
+                       clip->vfilter,
+                       clip->afilter);
+        }
+
+        auto cached = create_cached_producer(dependencies.format_desc,
+                                             clip->path,
+                                             clip->vfilter,
+                                             clip->afilter,
+                                             clip->start,
+                                             clip->duration,
+                                             clip->loop);
+        if (cached) {
+            return spl::make_shared_ptr(std::move(cached));
+        }
+
+        auto producer = spl::make_shared<ffmpeg_producer>(dependencies.frame_factory,
+                                                          dependencies.format_desc,
+                                                          clip->name,
+                                                          clip->path,
+                                                          clip->vfilter,
+                                                          clip->afilter,
+                                                          clip->start,
+                                                          clip->duration,
+                                                          clip->loop);
         return core::create_destroy_proxy(std::move(producer));
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
@@ -373,4 +560,16 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     return core::frame_producer::empty();
 }
 
+bool preload_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                      const core::video_format_desc&              format_desc,
+                      const std::vector<std::wstring>&            params)
+{
+    const auto clip = parse_clip_params(params);
+    if (!clip) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(params.at(0)));
+    }
+
+    return cache_clip(frame_factory, format_desc, clip->name, clip->path, clip->vfilter, clip->afilter);
+}
+
 }} // namespace caspar::ffmpeg
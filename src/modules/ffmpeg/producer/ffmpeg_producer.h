@@ -25,6 +25,7 @@
 
 #include <core/fwd.h>
 
+#include <set>
 #include <string>
 #include <vector>
 
@@ -33,4 +34,16 @@ namespace caspar { namespace ffmpeg {
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
                                                       const std::vector<std::wstring>&         params);
 
+// Queues the clip named by params for the clip cache, false if the clip can not be cached. Throws file_not_found if
+// params name no playable clip.
+bool preload_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                      const core::video_format_desc&              format_desc,
+                      const std::vector<std::wstring>&            params);
+
+void clear_producer_pool();
+
+const std::set<std::wstring>& supported_extensions();
+
+bool is_valid_file(const std::wstring& filename);
+
 }} // namespace caspar::ffmpeg
@@ -0,0 +1,567 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "thumbnail_generator.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/base64.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <core/module_dependencies.h>
+#include <core/producer/media_info/media_scanner.h>
+
+#include <protocol/amcp/AMCPCommand.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#pragma warning(push, 1)
+
+extern "C" {
+#define __STDC_CONSTANT_MACROS
+#define __STDC_LIMIT_MACROS
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+#pragma warning(pop)
+
+namespace caspar { namespace ffmpeg {
+
+std::vector<std::uint8_t> make_thumbnail(const std::wstring& path, int max_width, int max_height)
+{
+    AVFormatContext* input = nullptr;
+    FF(avformat_open_input(&input, u8(path).c_str(), nullptr, nullptr));
+    const auto input_ptr =
+        std::shared_ptr<AVFormatContext>(input, [](AVFormatContext* ptr) { avformat_close_input(&ptr); });
+
+    FF(avformat_find_stream_info(input, nullptr));
+
+    AVCodec*   codec = nullptr;
+    const auto index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (index < 0 || !codec) {
+        return {};
+    }
+
+    const auto st = input->streams[index];
+
+    // Nothing but the video stream needs to be read.
+    for (auto n = 0U; n < input->nb_streams; ++n) {
+        if (static_cast<int>(n) != index) {
+            input->streams[n]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    const auto decoder = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                                         [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+    if (!decoder) {
+        FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+    }
+
+    FF(avcodec_parameters_to_context(decoder.get(), st->codecpar));
+
+    // Decode keyframes only, at the lowest resolution that is still at least as large as the thumbnail.
+    auto lowres = 0;
+    while (lowres < av_codec_get_max_lowres(codec) && (st->codecpar->width >> (lowres + 1)) >= max_width &&
+           (st->codecpar->height >> (lowres + 1)) >= max_height) {
+        ++lowres;
+    }
+
+    FF(av_opt_set_int(decoder.get(), "lowres", lowres, 0));
+    FF(av_opt_set_int(decoder.get(), "threads", 1, 0));
+    decoder->skip_frame   = AVDISCARD_NONKEY;
+    decoder->pkt_timebase = st->time_base;
+
+    FF(avcodec_open2(decoder.get(), codec, nullptr));
+
+    // A tenth into the clip is past leaders and slates, but still representative of its content.
+    if (input->duration > 0 && !(input->iformat->flags & AVFMT_NOTIMESTAMPS)) {
+        const auto ts = (input->start_time != AV_NOPTS_VALUE ? input->start_time : 0) + input->duration / 10;
+        avformat_seek_file(input, -1, INT64_MIN, ts, ts, 0);
+    }
+
+    const auto frame  = alloc_frame();
+    const auto packet = alloc_packet();
+
+    auto flushed = false;
+    while (true) {
+        auto ret = avcodec_receive_frame(decoder.get(), frame.get());
+        if (ret == 0) {
+            break;
+        }
+        if (ret == AVERROR_EOF) {
+            return {};
+        }
+        if (ret != AVERROR(EAGAIN)) {
+            FF_RET(ret, "avcodec_receive_frame");
+        }
+
+        ret = av_read_frame(input, packet.get());
+        if (ret == AVERROR_EOF) {
+            if (flushed) {
+                return {};
+            }
+            FF(avcodec_send_packet(decoder.get(), nullptr));
+            flushed = true;
+            continue;
+        }
+        FF(ret);
+
+        if (packet->stream_index == index) {
+            ret = avcodec_send_packet(decoder.get(), packet.get());
+        }
+        av_packet_unref(packet.get());
+        if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_INVALIDDATA) {
+            FF_RET(ret, "avcodec_send_packet");
+        }
+    }
+
+    // Fit within the bounds at the display aspect ratio.
+    const auto sar           = av_guess_sample_aspect_ratio(input, st, frame.get());
+    const auto display_width = sar.num > 0 && sar.den > 0 ? frame->width * av_q2d(sar) : frame->width;
+    const auto scale  = std::min(max_width / display_width, max_height / static_cast<double>(frame->height));
+    const auto width  = std::max(2, static_cast<int>(display_width * scale) & ~1);
+    const auto height = std::max(2, static_cast<int>(frame->height * scale) & ~1);
+
+    const auto sws = std::shared_ptr<SwsContext>(sws_getContext(frame->width,
+                                                                frame->height,
+                                                                static_cast<AVPixelFormat>(frame->format),
+                                                                width,
+                                                                height,
+                                                                AV_PIX_FMT_YUVJ420P,
+                                                                SWS_BILINEAR,
+                                                                nullptr,
+                                                                nullptr,
+                                                                nullptr),
+                                                 [](SwsContext* ptr) { sws_freeContext(ptr); });
+    if (!sws) {
+        FF_RET(AVERROR(EINVAL), "sws_getContext");
+    }
+
+    const auto scaled = alloc_frame();
+    scaled->width     = width;
+    scaled->height    = height;
+    scaled->format    = AV_PIX_FMT_YUVJ420P;
+    FF(av_frame_get_buffer(scaled.get(), 32));
+
+    sws_scale(sws.get(), frame->data, frame->linesize, 0, frame->height, scaled->data, scaled->linesize);
+
+    const auto jpeg_codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    if (!jpeg_codec) {
+        FF_RET(AVERROR_ENCODER_NOT_FOUND, "avcodec_find_encoder");
+    }
+
+    const auto encoder = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(jpeg_codec),
+                                                         [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+    if (!encoder) {
+        FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+    }
+
+    encoder->width          = width;
+    encoder->height         = height;
+    encoder->pix_fmt        = AV_PIX_FMT_YUVJ420P;
+    encoder->time_base      = {1, 25};
+    encoder->global_quality = FF_QP2LAMBDA * 4;
+    encoder->flags |= AV_CODEC_FLAG_QSCALE;
+
+    FF(avcodec_open2(encoder.get(), jpeg_codec, nullptr));
+
+    scaled->pts     = 0;
+    scaled->quality = encoder->global_quality;
+
+    FF(avcodec_send_frame(encoder.get(), scaled.get()));
+    FF(avcodec_send_frame(encoder.get(), nullptr));
+    FF(avcodec_receive_packet(encoder.get(), packet.get()));
+
+    std::vector<std::uint8_t> result(packet->data, packet->data + packet->size);
+    av_packet_unref(packet.get());
+    return result;
+}
+
+namespace {
+
+// Identifies file content without reading all of it: FNV-1a over its size and its first and last 64 KiB.
+std::string content_hash(const std::wstring& path, std::uintmax_t size)
+{
+    const std::uintmax_t chunk = 64 * 1024;
+
+    std::uint64_t hash   = 14695981039346656037ULL;
+    auto          update = [&](const char* data, std::size_t length) {
+        for (std::size_t n = 0; n < length; ++n) {
+            hash = (hash ^ static_cast<unsigned char>(data[n])) * 1099511628211ULL;
+        }
+    };
+
+    update(reinterpret_cast<const char*>(&size), sizeof(size));
+
+    std::ifstream     file(u8(path), std::ios::binary);
+    std::vector<char> buffer(static_cast<std::size_t>(std::min(size, chunk)));
+
+    file.read(buffer.data(), buffer.size());
+    update(buffer.data(), static_cast<std::size_t>(file.gcount()));
+
+    if (size > chunk) {
+        file.seekg(static_cast<std::streamoff>(size - std::min(size - chunk, chunk)));
+        file.read(buffer.data(), buffer.size());
+        update(buffer.data(), static_cast<std::size_t>(file.gcount()));
+    }
+
+    std::ostringstream str;
+    str << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return str.str();
+}
+
+std::wstring format_iso_time(std::time_t time)
+{
+    using adjustor = boost::date_time::c_local_adjustor<boost::posix_time::ptime>;
+    return boost::posix_time::to_iso_wstring(adjustor::utc_to_local(boost::posix_time::from_time_t(time)));
+}
+
+struct thumbnail_entry
+{
+    std::uintmax_t size     = 0; // of the media file
+    std::time_t    modified = 0; // of the media file
+    std::string    key;
+};
+
+// Thumbnails are stored as <content hash>-<modification time>.jpg, so that copies and renamed files share a
+// thumbnail and a changed file gets a new one. An index of which media file has which key is kept alongside, so
+// that files are only hashed again when they change.
+class thumbnail_generator
+{
+    const spl::shared_ptr<core::media_scanner> media_scanner_;
+    const std::wstring                         folder_;
+    const int                                  width_;
+    const int                                  height_;
+
+    std::mutex                              mutex_;
+    std::map<std::wstring, thumbnail_entry> entries_; // by media path
+    bool                                    dirty_ = false;
+
+    std::mutex                   queue_mutex_;
+    std::condition_variable      queue_cond_;
+    std::deque<core::media_file> queue_;
+    std::set<std::wstring>       queued_;
+    bool                         abort_ = false;
+    std::vector<std::thread>     workers_;
+
+    std::wstring index_path() const { return folder_ + L"thumbnails.index"; }
+
+    std::wstring thumbnail_path(const std::string& key) const { return folder_ + u16(key) + L".jpg"; }
+
+    // The key of file if the index has a current one. Never reads the file, so it is safe on the AMCP thread.
+    boost::optional<std::string> indexed_key(const core::media_file& file)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = entries_.find(file.path);
+        if (it == entries_.end() || it->second.size != file.size || it->second.modified != file.modified) {
+            return boost::none;
+        }
+        return it->second.key;
+    }
+
+    // Hashes file if the index has no current key for it, only called by the workers.
+    std::string key_of(const core::media_file& file)
+    {
+        if (auto key = indexed_key(file)) {
+            return *key;
+        }
+
+        thumbnail_entry entry;
+        entry.size     = file.size;
+        entry.modified = file.modified;
+        entry.key      = content_hash(file.path, file.size) + "-" + std::to_string(file.modified);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[file.path] = entry;
+        dirty_              = true;
+        return entry.key;
+    }
+
+    void generate(const core::media_file& file)
+    {
+        const auto key  = key_of(file);
+        const auto path = thumbnail_path(key);
+
+        if (boost::filesystem::exists(path)) {
+            return;
+        }
+
+        const auto jpeg = make_thumbnail(file.path, width_, height_);
+        if (jpeg.empty()) {
+            return;
+        }
+
+        const auto    tmp_path = path + L".tmp";
+        std::ofstream out(u8(tmp_path), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+        out.close();
+        boost::filesystem::rename(tmp_path, path);
+    }
+
+    void load_index()
+    {
+        std::ifstream file(u8(index_path()), std::ios::binary);
+
+        std::string line;
+        while (std::getline(file, line)) {
+            std::vector<std::string> fields;
+            boost::split(fields, line, boost::is_any_of("\t"));
+            if (fields.size() != 4) {
+                continue;
+            }
+
+            try {
+                thumbnail_entry entry;
+                entry.size               = std::stoull(fields[1]);
+                entry.modified           = static_cast<std::time_t>(std::stoll(fields[2]));
+                entry.key                = fields[3];
+                entries_[u16(fields[0])] = entry;
+            } catch (...) {
+                // Hashed again when needed.
+            }
+        }
+    }
+
+    void save_index()
+    {
+        std::map<std::wstring, thumbnail_entry> entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!dirty_) {
+                return;
+            }
+            entries = entries_;
+            dirty_  = false;
+        }
+
+        const auto    tmp_path = index_path() + L".tmp";
+        std::ofstream file(u8(tmp_path), std::ios::binary | std::ios::trunc);
+        for (auto& p : entries) {
+            file << u8(p.first) << '\t' << p.second.size << '\t' << p.second.modified << '\t' << p.second.key << '\n';
+        }
+        file.close();
+
+        boost::system::error_code ec;
+        boost::filesystem::rename(tmp_path, index_path(), ec);
+    }
+
+    void run()
+    {
+        set_thread_name(L"thumbnails");
+        set_thread_low_priority();
+
+        while (true) {
+            core::media_file file;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex_);
+                queue_cond_.wait(lock, [&] { return abort_ || !queue_.empty(); });
+                if (abort_) {
+                    return;
+                }
+                file = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            try {
+                generate(file);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(warning) << L"[thumbnails] Failed to generate thumbnail for " << file.path;
+            }
+
+            bool idle;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex_);
+                queued_.erase(file.path);
+                idle = queued_.empty();
+            }
+
+            if (idle) {
+                save_index();
+            }
+        }
+    }
+
+  public:
+    explicit thumbnail_generator(spl::shared_ptr<core::media_scanner> media_scanner)
+        : media_scanner_(std::move(media_scanner))
+        , folder_(env::properties().get(L"configuration.thumbnails.path", env::initial_folder() + L"/thumbnail/"))
+        , width_(env::properties().get(L"configuration.thumbnails.width", 256))
+        , height_(env::properties().get(L"configuration.thumbnails.height", 144))
+    {
+        boost::filesystem::create_directories(folder_);
+        load_index();
+
+        const auto threads = std::max(1, env::properties().get(L"configuration.thumbnails.threads", 1));
+        for (int n = 0; n < threads; ++n) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~thumbnail_generator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            abort_ = true;
+        }
+        queue_cond_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+        save_index();
+    }
+
+    void enqueue(const core::media_file& file)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            if (!queued_.insert(file.path).second) {
+                return;
+            }
+            queue_.push_back(file);
+        }
+        queue_cond_.notify_one();
+    }
+
+    std::wstring list_command(protocol::amcp::command_context& ctx)
+    {
+        std::wstringstream replyString;
+        replyString << L"200 THUMBNAIL LIST OK\r\n";
+
+        // The thumbnails are looked at on disk outside of the lock, which the workers need for every file.
+        for (auto& file : media_scanner_->media()) {
+            auto key = indexed_key(file);
+            if (!key) {
+                continue;
+            }
+
+            boost::system::error_code ec;
+            const auto                path     = thumbnail_path(*key);
+            const auto                size     = boost::filesystem::file_size(path, ec);
+            const auto                modified = boost::filesystem::last_write_time(path, ec);
+            if (!ec) {
+                replyString << L"\"" << file.name << L"\" " << format_iso_time(modified) << L" " << size << L"\r\n";
+            }
+        }
+
+        replyString << L"\r\n";
+        return replyString.str();
+    }
+
+    std::wstring retrieve_command(protocol::amcp::command_context& ctx)
+    {
+        auto file = media_scanner_->find_media(ctx.parameters.at(0));
+        if (!file) {
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters.at(0) + L" not found"));
+        }
+
+        // Files the index has no current key for are hashed by the workers along with generating their thumbnail.
+        const auto    key = indexed_key(*file);
+        std::ifstream jpeg;
+        if (key) {
+            jpeg.open(u8(thumbnail_path(*key)), std::ios::binary);
+        }
+        if (!jpeg.is_open()) {
+            enqueue(*file);
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"No thumbnail for " + ctx.parameters.at(0)));
+        }
+
+        const std::vector<char> bytes((std::istreambuf_iterator<char>(jpeg)), std::istreambuf_iterator<char>());
+        return L"201 THUMBNAIL RETRIEVE OK\r\n" + u16(to_base64(bytes.data(), bytes.size())) + L"\r\n";
+    }
+
+    std::wstring generate_command(protocol::amcp::command_context& ctx)
+    {
+        auto file = media_scanner_->find_media(ctx.parameters.at(0));
+        if (!file) {
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters.at(0) + L" not found"));
+        }
+
+        enqueue(*file);
+        return L"202 THUMBNAIL GENERATE OK\r\n";
+    }
+
+    std::wstring generate_all_command(protocol::amcp::command_context& ctx)
+    {
+        for (auto& file : media_scanner_->media()) {
+            enqueue(file);
+        }
+        return L"202 THUMBNAIL GENERATE_ALL OK\r\n";
+    }
+};
+
+std::shared_ptr<thumbnail_generator> g_thumbnail_generator;
+
+} // namespace
+
+void init_thumbnails(const core::module_dependencies& dependencies)
+{
+    g_thumbnail_generator = std::make_shared<thumbnail_generator>(dependencies.media_scanner);
+
+    // The repository outlives the module, so the commands must not keep the generator and its workers alive.
+    auto command = [](std::wstring (thumbnail_generator::*func)(protocol::amcp::command_context&)) {
+        std::weak_ptr<thumbnail_generator> weak = g_thumbnail_generator;
+        return [weak, func](protocol::amcp::command_context& ctx) {
+            auto generator = weak.lock();
+            if (!generator) {
+                CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info(L"Thumbnail generator is not running"));
+            }
+            return ((*generator).*func)(ctx);
+        };
+    };
+
+    auto& repo = *dependencies.command_repository;
+    repo.register_command(
+        L"Thumbnail Commands", L"THUMBNAIL LIST", command(&thumbnail_generator::list_command), 0);
+    repo.register_command(
+        L"Thumbnail Commands", L"THUMBNAIL RETRIEVE", command(&thumbnail_generator::retrieve_command), 1);
+    repo.register_command(
+        L"Thumbnail Commands", L"THUMBNAIL GENERATE", command(&thumbnail_generator::generate_command), 1);
+    repo.register_command(
+        L"Thumbnail Commands", L"THUMBNAIL GENERATE_ALL", command(&thumbnail_generator::generate_all_command), 0);
+}
+
+void uninit_thumbnails() { g_thumbnail_generator.reset(); }
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/fwd.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+// Decodes a representative frame of the video at path and encodes it as a JPEG fitting within max_width by
+// max_height. Empty if the file has no video.
+std::vector<std::uint8_t> make_thumbnail(const std::wstring& path, int max_width, int max_height);
+
+// Registers the THUMBNAIL commands, served by a thumbnail cache and a low priority worker pool.
+void init_thumbnails(const core::module_dependencies& dependencies);
+void uninit_thumbnails();
+
+}} // namespace caspar::ffmpeg
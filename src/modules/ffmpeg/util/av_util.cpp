@@ -2,6 +2,8 @@
 
 #include "av_assert.h"
 
+#include <common/log.h>
+
 #if defined(_MSC_VER)
 #pragma warning(push)
 #pragma warning(disable : 4244)
@@ -10,6 +12,8 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavfilter/avfilter.h>
 #include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 }
 #if defined(_MSC_VER)
@@ -18,6 +22,9 @@ extern "C" {
 
 #include <tbb/parallel_for.h>
 
+#include <mutex>
+#include <vector>
+
 namespace caspar { namespace ffmpeg {
 
 std::shared_ptr<AVFrame> alloc_frame()
@@ -36,6 +43,169 @@ std::shared_ptr<AVPacket> alloc_packet()
     return packet;
 }
 
+namespace {
+
+// A frame from the frame factory that a decoder renders into. The decoder and filters may hold on to its planes after
+// make_frame has handed the frame on, so they are kept alive until the last AVBufferRef is gone.
+struct direct_frame
+{
+    std::mutex                           mutex;
+    std::unique_ptr<core::mutable_frame> frame;
+    std::vector<array<std::uint8_t>>     planes;
+};
+
+// Marks AVFrame::opaque_ref as referring to a direct_frame.
+const std::uint8_t direct_frame_tag = 0;
+
+struct direct_rendering
+{
+    const void*                          tag;
+    std::shared_ptr<core::frame_factory> frame_factory;
+};
+
+AVBufferRef* make_buffer_ref(std::uint8_t* data, int size, const std::shared_ptr<direct_frame>& owner)
+{
+    return av_buffer_create(
+        data,
+        size,
+        [](void* opaque, std::uint8_t*) { delete static_cast<std::shared_ptr<direct_frame>*>(opaque); },
+        new std::shared_ptr<direct_frame>(owner),
+        0);
+}
+
+// Undoes a partial get_direct_buffer without touching the properties the decoder has set on the frame.
+void release_direct_buffer(AVFrame* frame)
+{
+    for (int n = 0; n < AV_NUM_DATA_POINTERS; ++n) {
+        av_buffer_unref(&frame->buf[n]);
+        frame->data[n]     = nullptr;
+        frame->linesize[n] = 0;
+    }
+    av_buffer_unref(&frame->opaque_ref);
+}
+
+int get_direct_buffer(AVCodecContext* ctx, AVFrame* frame, int flags)
+{
+    try {
+        const auto self   = static_cast<direct_rendering*>(ctx->opaque);
+        const auto format = static_cast<AVPixelFormat>(frame->format);
+        auto       desc   = pixel_format_desc(format, frame->width, frame->height);
+
+        if (desc.format == core::pixel_format::invalid) {
+            return avcodec_default_get_buffer2(ctx, frame, flags);
+        }
+
+        // The decoder may write past the picture up to the aligned dimensions, but the rows must be packed as the
+        // frame factory expects them.
+        auto width  = frame->width;
+        auto height = frame->height;
+        int  linesize_align[AV_NUM_DATA_POINTERS];
+        avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+
+        int linesizes[4];
+        if (av_image_fill_linesizes(linesizes, format, width) < 0) {
+            return avcodec_default_get_buffer2(ctx, frame, flags);
+        }
+
+        const auto av_desc = av_pix_fmt_desc_get(format);
+        for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+            if (desc.planes[n].linesize != linesizes[n] || linesizes[n] % linesize_align[n] != 0) {
+                return avcodec_default_get_buffer2(ctx, frame, flags);
+            }
+            const auto plane_height = n == 1 || n == 2 ? -((-height) >> av_desc->log2_chroma_h) : height;
+            desc.planes[n].size     = linesizes[n] * plane_height + 16 + linesize_align[n] - 1;
+        }
+
+        auto owner   = std::make_shared<direct_frame>();
+        owner->frame = std::make_unique<core::mutable_frame>(self->frame_factory->create_frame(self->tag, desc));
+
+        for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+            if (owner->frame->image_data(n).size() < static_cast<std::size_t>(desc.planes[n].size)) {
+                return avcodec_default_get_buffer2(ctx, frame, flags);
+            }
+        }
+
+        for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+            const auto data    = owner->frame->image_data(n).begin();
+            frame->data[n]     = data;
+            frame->linesize[n] = linesizes[n];
+            frame->buf[n]      = make_buffer_ref(data, desc.planes[n].size, owner);
+            if (!frame->buf[n]) {
+                release_direct_buffer(frame);
+                return AVERROR(ENOMEM);
+            }
+        }
+
+        frame->opaque_ref = make_buffer_ref(const_cast<std::uint8_t*>(&direct_frame_tag), 1, owner);
+        if (!frame->opaque_ref) {
+            release_direct_buffer(frame);
+            return AVERROR(ENOMEM);
+        }
+
+        return 0;
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        release_direct_buffer(frame);
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+}
+
+// The frame the decoder rendered video into, if it is still exactly the picture that came out of the filters.
+std::unique_ptr<core::mutable_frame> take_direct_frame(const AVFrame& video, const core::pixel_format_desc& pix_desc)
+{
+    if (!video.opaque_ref || video.opaque_ref->data != &direct_frame_tag) {
+        return nullptr;
+    }
+
+    const auto owner = *static_cast<std::shared_ptr<direct_frame>*>(av_buffer_get_opaque(video.opaque_ref));
+
+    std::lock_guard<std::mutex> lock(owner->mutex);
+
+    if (!owner->frame || owner->frame->pixel_format_desc().format != pix_desc.format ||
+        owner->frame->pixel_format_desc().planes.size() != pix_desc.planes.size()) {
+        return nullptr;
+    }
+
+    for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
+        const auto& plane = owner->frame->pixel_format_desc().planes[n];
+        if (owner->frame->image_data(n).begin() != video.data[n] || video.linesize[n] != plane.linesize ||
+            pix_desc.planes[n].width != plane.width || pix_desc.planes[n].height != plane.height) {
+            return nullptr;
+        }
+    }
+
+    for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
+        owner->planes.push_back(owner->frame->image_data(n).share());
+    }
+
+    return std::move(owner->frame);
+}
+
+} // namespace
+
+std::shared_ptr<void>
+enable_direct_rendering(AVCodecContext* ctx, const void* tag, std::shared_ptr<core::frame_factory> frame_factory)
+{
+    const auto codec_desc = avcodec_descriptor_get(ctx->codec_id);
+
+    if (!frame_factory || ctx->codec_type != AVMEDIA_TYPE_VIDEO || !ctx->codec ||
+        !(ctx->codec->capabilities & AV_CODEC_CAP_DR1) || !codec_desc ||
+        !(codec_desc->props & AV_CODEC_PROP_INTRA_ONLY)) {
+        return nullptr;
+    }
+
+    auto self = std::make_shared<direct_rendering>();
+
+    self->tag           = tag;
+    self->frame_factory = std::move(frame_factory);
+
+    ctx->opaque                = self.get();
+    ctx->get_buffer2           = get_direct_buffer;
+    ctx->thread_safe_callbacks = 1;
+
+    return self;
+}
+
 core::mutable_frame make_frame(void*                    tag,
                                core::frame_factory&     frame_factory,
                                std::shared_ptr<AVFrame> video,
@@ -45,23 +215,27 @@ core::mutable_frame make_frame(void*                    tag,
         video ? pixel_format_desc(static_cast<AVPixelFormat>(video->format), video->width, video->height)
               : core::pixel_format_desc(core::pixel_format::invalid);
 
-    auto frame = frame_factory.create_frame(tag, pix_desc);
+    auto frame = video ? take_direct_frame(*video, pix_desc) : nullptr;
+
+    if (!frame) {
+        frame = std::make_unique<core::mutable_frame>(frame_factory.create_frame(tag, pix_desc));
 
-    if (video) {
-        for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
-            tbb::parallel_for(0, pix_desc.planes[n].height, [&](int y) {
-                std::memcpy(frame.image_data(n).begin() + y * pix_desc.planes[n].linesize,
-                            video->data[n] + y * video->linesize[n],
-                            pix_desc.planes[n].linesize);
-            });
+        if (video) {
+            for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
+                tbb::parallel_for(0, pix_desc.planes[n].height, [&](int y) {
+                    std::memcpy(frame->image_data(n).begin() + y * pix_desc.planes[n].linesize,
+                                video->data[n] + y * video->linesize[n],
+                                pix_desc.planes[n].linesize);
+                });
+            }
         }
     }
 
     if (audio) {
         // TODO This is a bit of a hack
-        frame.audio_data() = std::vector<int32_t>(audio->nb_samples * 8, 0);
-        auto dst           = frame.audio_data().data();
-        auto src           = reinterpret_cast<int32_t*>(audio->data[0]);
+        frame->audio_data() = std::vector<int32_t>(audio->nb_samples * 8, 0);
+        auto dst            = frame->audio_data().data();
+        auto src            = reinterpret_cast<int32_t*>(audio->data[0]);
         tbb::parallel_for(0, audio->nb_samples, [&](int i) {
             for (auto j = 0; j < std::min(8, audio->channels); ++j) {
                 dst[i * 8 + j] = src[i * audio->channels + j];
@@ -69,7 +243,7 @@ core::mutable_frame make_frame(void*                    tag,
         });
     }
 
-    return frame;
+    return std::move(*frame);
 }
 
 core::pixel_format get_pixel_format(AVPixelFormat pix_fmt)
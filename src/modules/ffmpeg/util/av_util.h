@@ -24,6 +24,13 @@ core::mutable_frame     make_frame(void*                    tag,
                                    std::shared_ptr<AVFrame> video,
                                    std::shared_ptr<AVFrame> audio);
 
+// Makes a video decoder render straight into frames from frame_factory, which make_frame then hands on without
+// copying. Only done for intra-only codecs, since the frame factory's buffers are not meant to be read back, which
+// also means the caller must only ask for it when the filters hand the decoded pictures on untouched. Must be called
+// before avcodec_open2. Returns what has to outlive the codec context, or nullptr if nothing was changed.
+std::shared_ptr<void>
+enable_direct_rendering(AVCodecContext* ctx, const void* tag, std::shared_ptr<core::frame_factory> frame_factory);
+
 std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 
@@ -227,8 +227,10 @@ void init(core::module_dependencies dependencies)
 {
     copy_template_hosts();
 
-    dependencies.producer_registry->register_producer_factory(L"Flash Producer (.ct)", create_ct_producer);
-    dependencies.producer_registry->register_producer_factory(L"Flash Producer (.swf)", create_swf_producer);
+    dependencies.producer_registry->register_producer_factory(
+        L"Flash Producer (.ct)", create_ct_producer, {{}, {}, {L".ct"}});
+    dependencies.producer_registry->register_producer_factory(
+        L"Flash Producer (.swf)", create_swf_producer, {{}, {}, {L".swf"}});
     dependencies.cg_registry->register_cg_producer(
         L"flash",
         {L".ft", L".ct"},
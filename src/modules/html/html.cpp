@@ -231,7 +231,8 @@ bool intercept_command_line(int argc, char** argv)
 
 void init(core::module_dependencies dependencies)
 {
-    dependencies.producer_registry->register_producer_factory(L"HTML Producer", html::create_producer);
+    dependencies.producer_registry->register_producer_factory(
+        L"HTML Producer", html::create_producer, {{L"[HTML]"}, {L"http", L"https"}, {}});
 
     CefMainArgs main_args;
     g_cef_executor = std::make_unique<executor>(L"cef");
@@ -26,6 +26,7 @@
 
 #include "consumer/image_consumer.h"
 #include "producer/image_producer.h"
+#include "util/image_loader.h"
 
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
@@ -33,17 +34,31 @@
 #include <common/utf.h>
 
 #include <boost/algorithm/string/case_conv.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 namespace caspar { namespace image {
 
 std::wstring version() { return u16(FreeImage_GetVersion()); }
 
+bool extract_media_info(const std::wstring& path, core::media_info& info)
+{
+    auto ext = boost::to_lower_copy(boost::filesystem::path(path).extension().wstring());
+    if (supported_extensions().count(ext) == 0)
+        return false;
+
+    info.clip_type = L"STILL";
+    info.format    = ext.substr(1);
+    return true;
+}
+
 void init(core::module_dependencies dependencies)
 {
     FreeImage_Initialise();
-    dependencies.producer_registry->register_producer_factory(L"Image Producer", create_producer);
+    dependencies.producer_registry->register_producer_factory(
+        L"Image Producer", create_producer, {{}, {}, supported_extensions()});
     dependencies.consumer_registry->register_consumer_factory(L"Image Consumer", create_consumer);
+    dependencies.media_scanner->register_extractor(extract_media_info);
 }
 
 void uninit() { FreeImage_DeInitialise(); }
@@ -50,7 +50,8 @@ void init(core::module_dependencies dependencies)
         dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ndi",
                                                                                 create_preconfigured_ndi_consumer);
 
-        dependencies.producer_registry->register_producer_factory(L"NDI Producer", create_ndi_producer);
+        dependencies.producer_registry->register_producer_factory(
+            L"NDI Producer", create_ndi_producer, {{L"[NDI]"}, {L"ndi"}, {}});
 
         dependencies.command_repository->register_command(L"Query Commands", L"NDI LIST", ndi::list_command, 0);
 
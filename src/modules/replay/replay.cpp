@@ -82,7 +82,7 @@ std::wstring libjpeg_version()
 void init(core::module_dependencies dependencies)
 {
     dependencies.consumer_registry->register_consumer_factory(L"Replay Consumer", create_consumer);
-    dependencies.producer_registry->register_producer_factory(L"Replay Producer", create_producer);
+    dependencies.producer_registry->register_producer_factory(L"Replay Producer", create_producer, {{}, {}, {L".mav"}});
     CASPAR_LOG(info) << "[replay] JPEG lib version: " << libjpeg_version();
 }
 
@@ -41,10 +41,9 @@ struct command_context
     spl::shared_ptr<core::cg_producer_registry>          cg_registry;
     spl::shared_ptr<const core::frame_producer_registry> producer_registry;
     spl::shared_ptr<const core::frame_consumer_registry> consumer_registry;
+    spl::shared_ptr<const core::media_scanner>           media_scanner;
     std::function<void(bool)>                            shutdown_server_now;
     std::vector<std::wstring>                            parameters;
-    std::string                                          proxy_host;
-    std::string                                          proxy_port;
     std::weak_ptr<accelerator::accelerator_device>       ogl_device;
 
     int layer_index(int default_ = 0) const { return layer_id == -1 ? default_ : layer_id; }
@@ -57,9 +56,8 @@ struct command_context
                     spl::shared_ptr<core::cg_producer_registry>          cg_registry,
                     spl::shared_ptr<const core::frame_producer_registry> producer_registry,
                     spl::shared_ptr<const core::frame_consumer_registry> consumer_registry,
+                    spl::shared_ptr<const core::media_scanner>           media_scanner,
                     std::function<void(bool)>                            shutdown_server_now,
-                    std::string                                          proxy_host,
-                    std::string                                          proxy_port,
                     std::weak_ptr<accelerator::accelerator_device>       ogl_device)
         : client(std::move(client))
         , channel(channel)
@@ -69,9 +67,8 @@ struct command_context
         , cg_registry(std::move(cg_registry))
         , producer_registry(std::move(producer_registry))
         , consumer_registry(std::move(consumer_registry))
+        , media_scanner(std::move(media_scanner))
         , shutdown_server_now(shutdown_server_now)
-        , proxy_host(std::move(proxy_host))
-        , proxy_port(std::move(proxy_port))
         , ogl_device(std::move(ogl_device))
     {
     }
@@ -88,6 +85,7 @@ class AMCPCommand
     std::wstring      name_;
     std::wstring      replyString_;
     std::wstring      request_id_;
+    std::wstring      schedule_;
 
   public:
     AMCPCommand(const command_context&   ctx,
@@ -123,10 +121,16 @@ class AMCPCommand
 
     IO::ClientInfoPtr client() { return ctx_.client; }
 
+    std::shared_ptr<core::video_channel> channel() const { return ctx_.channel.channel; }
+
     std::wstring print() const { return name_; }
 
     void set_request_id(std::wstring request_id) { request_id_ = std::move(request_id); }
 
+    // Channel frame number or time of day timecode the command should take effect at, empty for immediately.
+    const std::wstring& schedule() const { return schedule_; }
+    void                set_schedule(std::wstring schedule) { schedule_ = std::move(schedule); }
+
     void SetReplyString(const std::wstring& str)
     {
         if (request_id_.empty())
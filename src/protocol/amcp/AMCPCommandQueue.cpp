@@ -23,10 +23,19 @@
 
 #include "AMCPCommandQueue.h"
 
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/lexical_cast.hpp>
 #include <common/except.h>
 #include <common/timer.h>
 
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <cmath>
+
 namespace caspar { namespace protocol { namespace amcp {
 
 namespace {
@@ -45,6 +54,36 @@ std::map<std::wstring, AMCPCommandQueue*>& get_instances()
     return queues;
 }
 
+// The channel frame number a command scheduled with "AT <frame>" or "AT <hh:mm:ss:ff>" should take effect at. A
+// timecode is the time of day of the server, counted in whole frames.
+int64_t scheduled_frame(const AMCPCommand& command)
+{
+    auto& schedule = command.schedule();
+    auto  channel  = command.channel();
+
+    if (schedule.find_first_not_of(L"0123456789") == std::wstring::npos)
+        return boost::lexical_cast<int64_t>(schedule);
+
+    std::vector<std::wstring> parts;
+    boost::split(parts, schedule, boost::is_any_of(L":;."));
+    if (parts.size() != 4)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid timecode " + schedule));
+
+    auto fps     = channel->video_format_desc().fps;
+    auto seconds = ((boost::lexical_cast<int>(parts[0]) * 60 + boost::lexical_cast<int>(parts[1])) * 60 +
+                    boost::lexical_cast<int>(parts[2])) +
+                   boost::lexical_cast<int>(parts[3]) / std::round(fps);
+
+    auto now = boost::posix_time::microsec_clock::local_time().time_of_day().total_microseconds() / 1000000.0;
+
+    // Timecodes more than half a day in the past are taken to be after midnight.
+    auto delta = seconds - now;
+    if (delta < -12 * 60 * 60)
+        delta += 24 * 60 * 60;
+
+    return channel->stage().frame_number() + static_cast<int64_t>(std::llround(delta * fps));
+}
+
 } // namespace
 
 AMCPCommandQueue::AMCPCommandQueue(const std::wstring& name)
@@ -89,6 +128,9 @@ void AMCPCommandQueue::AddCommand(AMCPCommand::ptr_type pCurrentCommand)
 
                 CASPAR_LOG(debug) << "Executing command: " << print;
 
+                core::scoped_stage_schedule schedule(
+                    pCurrentCommand->schedule().empty() ? -1 : scheduled_frame(*pCurrentCommand));
+
                 if (pCurrentCommand->Execute())
                     CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << print;
                 else
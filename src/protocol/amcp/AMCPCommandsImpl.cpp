@@ -27,7 +27,6 @@
 
 #include "AMCPCommandsImpl.h"
 
-#include "../util/http_request.h"
 #include "AMCPCommandQueue.h"
 #include "amcp_command_repository.h"
 
@@ -42,10 +41,12 @@
 #include <core/consumer/output.h>
 #include <core/diagnostics/call_context.h>
 #include <core/diagnostics/osd_graph.h>
+#include <core/frame/animation.h>
 #include <core/frame/frame_transform.h>
 #include <core/mixer/mixer.h>
 #include <core/producer/cg_proxy.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/media_info/media_scanner.h>
 #include <core/producer/stage.h>
 #include <core/producer/transition/sting_producer.h>
 #include <core/producer/transition/transition_producer.h>
@@ -60,6 +61,7 @@
 #include <boost/algorithm/string/regex.hpp>
 #include <boost/archive/iterators/base64_from_binary.hpp>
 #include <boost/archive/iterators/insert_linebreaks.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -214,6 +216,74 @@ core::frame_producer_dependencies get_producer_dependencies(const std::shared_pt
                                              ctx.cg_registry);
 }
 
+bool take_param(const std::wstring& name, std::vector<std::wstring>& params)
+{
+    auto it = std::find_if(
+        params.begin(), params.end(), [&](const std::wstring& param) { return boost::iequals(param, name); });
+    if (it == params.end())
+        return false;
+
+    params.erase(it);
+    return true;
+}
+
+// Producers loaded with ASYNC that PLAY may have to wait for, by channel and layer.
+class pending_loads
+{
+    std::mutex                                              mutex_;
+    std::map<std::pair<int, int>, std::shared_future<void>> loads_;
+
+  public:
+    static pending_loads& instance()
+    {
+        static pending_loads loads;
+        return loads;
+    }
+
+    void set(int channel, int layer, std::shared_future<void> ready)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loads_[std::make_pair(channel, layer)] = std::move(ready);
+    }
+
+    std::shared_future<void> get(int channel, int layer)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = loads_.find(std::make_pair(channel, layer));
+        return it != loads_.end() ? it->second : std::shared_future<void>();
+    }
+
+    void erase(int channel, int layer)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loads_.erase(std::make_pair(channel, layer));
+    }
+
+    void erase(int channel)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loads_.erase(loads_.lower_bound(std::make_pair(channel, std::numeric_limits<int>::min())),
+                     loads_.upper_bound(std::make_pair(channel, std::numeric_limits<int>::max())));
+    }
+};
+
+// Creates the producer, or with ASYNC a placeholder for it which is replaced once it has been constructed.
+spl::shared_ptr<core::frame_producer> create_producer(command_context& ctx, std::wstring& reply)
+{
+    auto dependencies = get_producer_dependencies(ctx.channel.channel, ctx);
+
+    if (!take_param(L"ASYNC", ctx.parameters)) {
+        pending_loads::instance().erase(ctx.channel_index, ctx.layer_index());
+        return ctx.producer_registry->create_producer(dependencies, ctx.parameters);
+    }
+
+    auto pending = ctx.producer_registry->create_producer_async(dependencies, ctx.parameters);
+    pending_loads::instance().set(ctx.channel_index, ctx.layer_index(), pending.ready);
+
+    reply = std::to_wstring(pending.id);
+    return pending.producer;
+}
+
 // Basic Commands
 
 std::wstring loadbg_command(command_context& ctx)
@@ -223,8 +293,10 @@ std::wstring loadbg_command(command_context& ctx)
     core::diagnostics::call_context::for_thread().video_channel = ctx.channel_index + 1;
     core::diagnostics::call_context::for_thread().layer         = ctx.layer_index();
 
+    std::wstring pending_id;
+
     auto channel = ctx.channel.channel;
-    auto pFP     = ctx.producer_registry->create_producer(get_producer_dependencies(channel, ctx), ctx.parameters);
+    auto pFP     = create_producer(ctx, pending_id);
 
     if (pFP == frame_producer::empty())
         CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters.size() > 0 ? ctx.parameters[0] : L""));
@@ -249,6 +321,9 @@ std::wstring loadbg_command(command_context& ctx)
 
     channel->stage().load(ctx.layer_index(), transition_producer, false, auto_play); // TODO: LOOP
 
+    if (!pending_id.empty())
+        return L"201 LOADBG OK\r\n" + pending_id + L"\r\n";
+
     return L"202 LOADBG OK\r\n";
 }
 
@@ -257,20 +332,37 @@ std::wstring load_command(command_context& ctx)
     core::diagnostics::scoped_call_context save;
     core::diagnostics::call_context::for_thread().video_channel = ctx.channel_index + 1;
     core::diagnostics::call_context::for_thread().layer         = ctx.layer_index();
-    auto pFP =
-        ctx.producer_registry->create_producer(get_producer_dependencies(ctx.channel.channel, ctx), ctx.parameters);
+
+    std::wstring pending_id;
+
+    auto pFP  = create_producer(ctx, pending_id);
     auto pFP2 = create_transition_producer(pFP, transition_info{});
 
     ctx.channel.channel->stage().load(ctx.layer_index(), pFP2, true);
 
+    if (!pending_id.empty())
+        return L"201 LOAD OK\r\n" + pending_id + L"\r\n";
+
     return L"202 LOAD OK\r\n";
 }
 
 std::wstring play_command(command_context& ctx)
 {
+    // A producer loaded with ASYNC is waited for, unless NOWAIT asks to fail should it not be ready yet.
+    auto wait = !take_param(L"NOWAIT", ctx.parameters);
+
     if (!ctx.parameters.empty())
         loadbg_command(ctx);
 
+    auto ready = pending_loads::instance().get(ctx.channel_index, ctx.layer_index());
+    if (ready.valid()) {
+        if (!wait && ready.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Producer is still loading."));
+
+        pending_loads::instance().erase(ctx.channel_index, ctx.layer_index());
+        ready.get();
+    }
+
     ctx.channel.channel->stage().play(ctx.layer_index());
 
     return L"202 PLAY OK\r\n";
@@ -297,10 +389,13 @@ std::wstring stop_command(command_context& ctx)
 std::wstring clear_command(command_context& ctx)
 {
     int index = ctx.layer_index(std::numeric_limits<int>::min());
-    if (index != std::numeric_limits<int>::min())
+    if (index != std::numeric_limits<int>::min()) {
+        pending_loads::instance().erase(ctx.channel_index, index);
         ctx.channel.channel->stage().clear(index);
-    else
+    } else {
+        pending_loads::instance().erase(ctx.channel_index);
         ctx.channel.channel->stage().clear();
+    }
 
     return L"202 CLEAR OK\r\n";
 }
@@ -333,15 +428,23 @@ std::wstring swap_command(command_context& ctx)
         boost::split(strs, ctx.parameters[0], boost::is_any_of(L"-"));
 
         auto ch1 = ctx.channel.channel;
-        auto ch2 = ctx.channels.at(std::stoi(strs.at(0)) - 1);
+        auto c2  = std::stoi(strs.at(0)) - 1;
+        auto ch2 = ctx.channels.at(c2);
 
         int l1 = ctx.layer_index();
         int l2 = std::stoi(strs.at(1));
 
+        // A PLAY after the swap must not wait for a load that has moved to the other layer.
+        pending_loads::instance().erase(ctx.channel_index, l1);
+        pending_loads::instance().erase(c2, l2);
         ch1->stage().swap_layer(l1, l2, ch2.channel->stage(), swap_transforms);
     } else {
         auto ch1 = ctx.channel.channel;
-        auto ch2 = ctx.channels.at(std::stoi(ctx.parameters[0]) - 1);
+        auto c2  = std::stoi(ctx.parameters[0]) - 1;
+        auto ch2 = ctx.channels.at(c2);
+
+        pending_loads::instance().erase(ctx.channel_index);
+        pending_loads::instance().erase(c2);
         ch1->stage().swap_layers(ch2.channel->stage(), swap_transforms);
     }
 
@@ -1179,6 +1282,56 @@ std::wstring mixer_commit_command(command_context& ctx)
     return L"202 MIXER OK\r\n";
 }
 
+// MIXER ANIMATE {[property:string] {[frame:int] [value:float] {[tween:string]|linear}}...}... {LOOP}
+// MIXER ANIMATE CLEAR
+std::wstring mixer_animate_command(command_context& ctx)
+{
+    auto& params = ctx.parameters;
+
+    if (params.size() == 1 && boost::iequals(params[0], L"CLEAR")) {
+        ctx.channel.channel->stage().animate(ctx.layer_index(), nullptr);
+        return L"202 MIXER OK\r\n";
+    }
+
+    auto is_tween = [&](const std::wstring& param) {
+        return !boost::iequals(param, L"LOOP") && !get_animation_property(param) &&
+               param.find_first_not_of(L"0123456789.-+") != std::wstring::npos;
+    };
+
+    std::vector<animation_track> tracks;
+    bool                         loop = false;
+
+    for (size_t n = 0; n < params.size();) {
+        if (boost::iequals(params[n], L"LOOP")) {
+            loop = true;
+            ++n;
+            continue;
+        }
+
+        auto property = get_animation_property(params[n]);
+        if (property) {
+            tracks.emplace_back(*property, std::vector<keyframe>());
+            ++n;
+            continue;
+        }
+
+        if (tracks.empty())
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown animation property " + params[n]));
+
+        keyframe key;
+        key.frame = std::stoi(params.at(n++));
+        key.value = std::stod(params.at(n++));
+        if (n < params.size() && is_tween(params[n]))
+            key.tween = tweener(params[n++]);
+
+        tracks.back().second.push_back(key);
+    }
+
+    ctx.channel.channel->stage().animate(ctx.layer_index(), std::make_shared<animation>(tracks, loop));
+
+    return L"202 MIXER OK\r\n";
+}
+
 std::wstring mixer_clear_command(command_context& ctx)
 {
     int layer = ctx.layer_id;
@@ -1231,52 +1384,87 @@ std::wstring channel_grid_command(command_context& ctx)
     return L"202 CHANNEL_GRID OK\r\n";
 }
 
-// Thumbnail Commands
+// Query Commands
 
-std::wstring make_request(command_context& ctx, const std::string& path, const std::wstring& default_response)
+std::wstring format_write_time(std::time_t time)
 {
-    auto res = http::request(ctx.proxy_host, ctx.proxy_port, path);
-    if (res.status_code >= 500 || res.body.size() == 0) {
-        CASPAR_LOG(error) << "Failed to connect to media-scanner. Is it running? \nReason: " << res.status_message;
-        return default_response;
-    }
-    return u16(res.body);
+    using adjustor = boost::date_time::c_local_adjustor<boost::posix_time::ptime>;
+
+    // YYYYMMDDTHHMMSS without the T.
+    auto str = boost::posix_time::to_iso_wstring(adjustor::utc_to_local(boost::posix_time::from_time_t(time)));
+    str.erase(std::remove(str.begin(), str.end(), L'T'), str.end());
+    return str.substr(0, 14);
 }
 
-std::wstring thumbnail_list_command(command_context& ctx)
+std::wstring media_file_line(const media_file& file)
 {
-    return make_request(ctx, "/thumbnail", L"501 THUMBNAIL LIST FAILED\r\n");
+    const auto& info = *file.info;
+
+    std::wstringstream str;
+    str << L"\"" << file.name << L"\" " << info.clip_type << L" " << file.size << L" "
+        << format_write_time(file.modified) << L" " << info.duration << L" ";
+    if (info.time_base != 0) {
+        str << info.time_base.numerator() << L"/" << info.time_base.denominator();
+    } else {
+        str << L"0";
+    }
+    str << L"\r\n";
+    return str.str();
 }
 
-std::wstring thumbnail_retrieve_command(command_context& ctx)
+std::wstring cinf_command(command_context& ctx)
 {
-    return make_request(
-        ctx, "/thumbnail/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL RETRIEVE FAILED\r\n");
+    auto file = ctx.media_scanner->find_media(ctx.parameters.at(0));
+    if (!file) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters.at(0) + L" not found"));
+    }
+
+    return L"201 CINF OK\r\n" + media_file_line(*file);
 }
 
-std::wstring thumbnail_generate_command(command_context& ctx)
+std::wstring cls_command(command_context& ctx)
 {
-    return make_request(
-        ctx, "/thumbnail/generate/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL GENERATE FAILED\r\n");
+    std::wstringstream replyString;
+    replyString << L"200 CLS OK\r\n";
+
+    for (auto& file : ctx.media_scanner->media()) {
+        replyString << media_file_line(file);
+    }
+
+    replyString << L"\r\n";
+    return replyString.str();
 }
 
-std::wstring thumbnail_generateall_command(command_context& ctx)
+std::wstring fls_command(command_context& ctx)
 {
-    return make_request(ctx, "/thumbnail/generate", L"501 THUMBNAIL GENERATE_ALL FAILED\r\n");
-}
+    std::wstringstream replyString;
+    replyString << L"200 FLS OK\r\n";
 
-// Query Commands
+    for (auto& file : ctx.media_scanner->fonts()) {
+        replyString << L"\"" << file.name << L"\"\r\n";
+    }
 
-std::wstring cinf_command(command_context& ctx)
-{
-    return make_request(ctx, "/cinf/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 CINF FAILED\r\n");
+    replyString << L"\r\n";
+    return replyString.str();
 }
 
-std::wstring cls_command(command_context& ctx) { return make_request(ctx, "/cls", L"501 CLS FAILED\r\n"); }
+std::wstring tls_command(command_context& ctx)
+{
+    std::wstringstream replyString;
+    replyString << L"200 TLS OK\r\n";
 
-std::wstring fls_command(command_context& ctx) { return make_request(ctx, "/fls", L"501 FLS FAILED\r\n"); }
+    for (auto& file : ctx.media_scanner->templates()) {
+        auto ext = boost::filesystem::path(file.path).extension().wstring();
+        if (!ctx.cg_registry->is_cg_extension(boost::to_lower_copy(ext))) {
+            continue;
+        }
 
-std::wstring tls_command(command_context& ctx) { return make_request(ctx, "/tls", L"501 TLS FAILED\r\n"); }
+        replyString << L"\"" << file.name << L"\" " << file.size << L" " << format_write_time(file.modified) << L"\r\n";
+    }
+
+    replyString << L"\r\n";
+    return replyString.str();
+}
 
 std::wstring version_command(command_context& ctx) { return L"201 VERSION OK\r\n" + env::version() + L"\r\n"; }
 
@@ -1530,15 +1718,11 @@ void register_commands(amcp_command_repository& repo)
     repo.register_channel_command(L"Mixer Commands", L"MIXER VOLUME", mixer_volume_command, 0);
     repo.register_channel_command(L"Mixer Commands", L"MIXER MASTERVOLUME", mixer_mastervolume_command, 0);
     repo.register_channel_command(L"Mixer Commands", L"MIXER GRID", mixer_grid_command, 1);
+    repo.register_channel_command(L"Mixer Commands", L"MIXER ANIMATE", mixer_animate_command, 1);
     repo.register_channel_command(L"Mixer Commands", L"MIXER COMMIT", mixer_commit_command, 0);
     repo.register_channel_command(L"Mixer Commands", L"MIXER CLEAR", mixer_clear_command, 0);
     repo.register_command(L"Mixer Commands", L"CHANNEL_GRID", channel_grid_command, 0);
 
-    repo.register_command(L"Thumbnail Commands", L"THUMBNAIL LIST", thumbnail_list_command, 0);
-    repo.register_command(L"Thumbnail Commands", L"THUMBNAIL RETRIEVE", thumbnail_retrieve_command, 1);
-    repo.register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE", thumbnail_generate_command, 1);
-    repo.register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE_ALL", thumbnail_generateall_command, 0);
-
     repo.register_command(L"Query Commands", L"CINF", cinf_command, 1);
     repo.register_command(L"Query Commands", L"CLS", cls_command, 0);
     repo.register_command(L"Query Commands", L"FLS", fls_command, 0);
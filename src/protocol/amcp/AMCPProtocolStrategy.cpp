@@ -87,6 +87,7 @@ struct AMCPProtocolStrategy::impl
     {
         std::shared_ptr<caspar::IO::lock_container> lock;
         std::wstring                                request_id;
+        std::wstring                                schedule;
         std::wstring                                command_name;
         AMCPCommand::ptr_type                       command;
         error_state                                 error = error_state::no_error;
@@ -175,6 +176,18 @@ struct AMCPProtocolStrategy::impl
                 tokens.pop_front();
             }
 
+            if (!tokens.empty() && boost::iequals(tokens.front(), L"AT")) {
+                tokens.pop_front();
+
+                if (tokens.empty()) {
+                    result.error = error_state::parameters_error;
+                    return false;
+                }
+
+                result.schedule = tokens.front();
+                tokens.pop_front();
+            }
+
             // Fail if no more tokens.
             if (tokens.empty()) {
                 result.error = error_state::command_error;
@@ -245,8 +258,14 @@ struct AMCPProtocolStrategy::impl
                     result.error = error_state::parameters_error;
             }
 
-            if (result.command)
+            if (result.command) {
                 result.command->set_request_id(result.request_id);
+                result.command->set_schedule(result.schedule);
+
+                // Only channel commands go through a stage that can hold them.
+                if (!result.schedule.empty() && !result.command->channel())
+                    result.error = error_state::parameters_error;
+            }
         } catch (std::out_of_range&) {
             CASPAR_LOG(error) << "Invalid channel specified.";
             result.error = error_state::channel_error;
@@ -68,10 +68,9 @@ struct amcp_command_repository::impl
     spl::shared_ptr<core::cg_producer_registry>          cg_registry;
     spl::shared_ptr<const core::frame_producer_registry> producer_registry;
     spl::shared_ptr<const core::frame_consumer_registry> consumer_registry;
+    spl::shared_ptr<const core::media_scanner>           media_scanner;
     std::weak_ptr<accelerator::accelerator_device>       ogl_device;
     std::function<void(bool)>                            shutdown_server_now;
-    std::string proxy_host = u8(caspar::env::properties().get(L"configuration.amcp.media-server.host", L"127.0.0.1"));
-    std::string proxy_port = u8(caspar::env::properties().get(L"configuration.amcp.media-server.port", L"8000"));
 
     std::map<std::wstring, std::pair<amcp_command_func, int>> commands;
     std::map<std::wstring, std::pair<amcp_command_func, int>> channel_commands;
@@ -79,11 +78,13 @@ struct amcp_command_repository::impl
     impl(const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
          const spl::shared_ptr<const core::frame_producer_registry>& producer_registry,
          const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
+         const spl::shared_ptr<const core::media_scanner>&           media_scanner,
          const std::weak_ptr<accelerator::accelerator_device>&       ogl_device,
          std::function<void(bool)>                                   shutdown_server_now)
         : cg_registry(cg_registry)
         , producer_registry(producer_registry)
         , consumer_registry(consumer_registry)
+        , media_scanner(media_scanner)
         , ogl_device(ogl_device)
         , shutdown_server_now(shutdown_server_now)
     {
@@ -104,9 +105,10 @@ amcp_command_repository::amcp_command_repository(
     const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
     const spl::shared_ptr<const core::frame_producer_registry>& producer_registry,
     const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
+    const spl::shared_ptr<const core::media_scanner>&           media_scanner,
     const std::weak_ptr<accelerator::accelerator_device>&       ogl_device,
     std::function<void(bool)>                                   shutdown_server_now)
-    : impl_(new impl(cg_registry, producer_registry, consumer_registry, ogl_device, shutdown_server_now))
+    : impl_(new impl(cg_registry, producer_registry, consumer_registry, media_scanner, ogl_device, shutdown_server_now))
 {
 }
 
@@ -129,9 +131,8 @@ AMCPCommand::ptr_type amcp_command_repository::create_command(const std::wstring
                         self.cg_registry,
                         self.producer_registry,
                         self.consumer_registry,
+                        self.media_scanner,
                         self.shutdown_server_now,
-                        self.proxy_host,
-                        self.proxy_port,
                         self.ogl_device);
 
     auto command = find_command(self.commands, s, ctx, tokens);
@@ -162,9 +163,8 @@ AMCPCommand::ptr_type amcp_command_repository::create_channel_command(const std:
                         self.cg_registry,
                         self.producer_registry,
                         self.consumer_registry,
+                        self.media_scanner,
                         self.shutdown_server_now,
-                        self.proxy_host,
-                        self.proxy_port,
                         self.ogl_device);
 
     auto command = find_command(self.channel_commands, s, ctx, tokens);
@@ -27,16 +27,22 @@
 #include "oscpack/OscOutboundPacketStream.h"
 
 #include <common/endian.h>
+#include <common/env.h>
 #include <common/utf.h>
 
 #include <core/monitor/monitor.h>
 
 #include <boost/asio.hpp>
 #include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <map>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 using namespace boost::asio::ip;
@@ -64,19 +70,93 @@ struct param_visitor : public boost::static_visitor<void>
     void operator()(const std::wstring& value) { o << u8(value).c_str(); }
 };
 
+// Encoded size of the arguments of a message, see param_visitor for the types used.
+struct size_visitor : public boost::static_visitor<std::size_t>
+{
+    static std::size_t padded(std::size_t size) { return (size + 4) & ~static_cast<std::size_t>(3); }
+
+    std::size_t operator()(const bool value) const { return 0; }
+    std::size_t operator()(const int32_t value) const { return 4; }
+    std::size_t operator()(const int64_t value) const { return 8; }
+    std::size_t operator()(const float value) const { return 4; }
+    std::size_t operator()(const double value) const { return 4; }
+    std::size_t operator()(const std::string& value) const { return padded(value.size()); }
+    std::size_t operator()(const std::wstring& value) const { return padded(u8(value).size()); }
+};
+
+std::size_t message_size(const std::string& path, const core::monitor::vector_t& values)
+{
+    size_visitor visitor;
+
+    auto size = size_visitor::padded(path.size()) + size_visitor::padded(values.size() + 1);
+    for (const auto& value : values) {
+        size += boost::apply_visitor(visitor, value);
+    }
+    return size;
+}
+
+// NTP time, as used by OSC time tags.
+uint64_t ntp_time(std::chrono::system_clock::time_point time)
+{
+    static const uint64_t seconds_1900_to_1970 = 2208988800ULL;
+
+    auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    auto seconds     = static_cast<uint64_t>(since_epoch / 1000000000) + seconds_1900_to_1970;
+    auto fraction    = (static_cast<uint64_t>(since_epoch % 1000000000) << 32) / 1000000000;
+    return seconds << 32 | fraction;
+}
+
+// Paths are identified by their interned name, which lives as long as the process.
+using path_t = const std::string*;
+
 struct client::impl : public spl::enable_shared_from_this<client::impl>
 {
+    struct subscriber
+    {
+        int                                                  reference_count = 0;
+        double                                               rate            = 0.0; // bundles per second, 0 = all
+        std::chrono::steady_clock::time_point                next_send;
+        std::chrono::steady_clock::time_point                next_refresh;
+        std::unordered_map<path_t, core::monitor::vector_t> sent;
+    };
+
+    struct value
+    {
+        core::monitor::vector_t               values;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    struct update
+    {
+        core::monitor::state                  state;
+        std::chrono::steady_clock::time_point time;
+        uint64_t                              time_tag;
+    };
+
     std::shared_ptr<boost::asio::io_context> service_;
     udp::socket                              socket_;
-    std::map<udp::endpoint, int>             reference_counts_by_endpoint_;
     std::vector<char>                        buffer_;
 
-    std::mutex              mutex_;
-    std::condition_variable cond_;
-    core::monitor::state    bundle_;
-    uint64_t                bundle_time_ = 0;
+    // Largest bundle sent, a single message that does not fit is sent on its own.
+    const std::size_t mtu_ =
+        std::max(64, env::properties().get(L"configuration.osc.mtu", 1400));
+
+    // How often every path is sent again, whether changed or not, so that lost packets are eventually repaired.
+    const std::chrono::milliseconds refresh_interval_{
+        static_cast<int64_t>(env::properties().get(L"configuration.osc.refresh-interval", 2.0) * 1000.0)};
 
-    uint64_t time_ = 0;
+    // Paths that have not been updated for this long are forgotten.
+    const std::chrono::seconds expiry_{1};
+
+    std::mutex                                             mutex_;
+    std::condition_variable                                cond_;
+    std::vector<update>                                    updates_;
+    std::map<udp::endpoint, std::shared_ptr<subscriber>> subscribers_;
+    std::atomic<int>                                       subscriber_count_{0};
+
+    // Owned by the sending thread.
+    std::unordered_map<path_t, value> values_;
+    uint64_t                          time_tag_ = 1;
 
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
@@ -90,59 +170,27 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         thread_ = std::thread([=] {
             try {
                 while (!abort_request_) {
-                    core::monitor::state       bundle;
-                    uint64_t                   bundle_time;
-                    std::vector<udp::endpoint> endpoints;
+                    std::vector<update>                                                  updates;
+                    std::vector<std::pair<udp::endpoint, std::shared_ptr<subscriber>>> subscribers;
 
                     {
                         std::unique_lock<std::mutex> lock(mutex_);
-                        cond_.wait(lock, [&] { return bundle_time_ > 0 || abort_request_; });
+                        cond_.wait_for(lock, std::chrono::milliseconds(100), [&] {
+                            return !updates_.empty() || abort_request_;
+                        });
 
                         if (abort_request_) {
                             return;
                         }
 
-                        bundle       = std::move(bundle_);
-                        bundle_time  = bundle_time_;
-                        bundle_time_ = 0;
-
-                        for (auto& p : reference_counts_by_endpoint_) {
-                            endpoints.push_back(p.first);
-                        }
+                        std::swap(updates, updates_);
+                        subscribers.assign(subscribers_.begin(), subscribers_.end());
                     }
 
-                    if (endpoints.empty()) {
-                        continue;
-                    }
-
-                    auto it = std::begin(bundle);
-
-                    while (it != std::end(bundle)) {
-                        ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer_.data()),
-                                                      static_cast<unsigned long>(buffer_.size()));
-
-                        o << ::osc::BeginBundle(bundle_time);
-
-                        // TODO (fix): < 2048 is a hack. Properly calculate if messages will fit.
-                        while (it != std::end(bundle) && o.Size() < 2048) {
-                            o << ::osc::BeginMessage(it->first.c_str());
+                    merge(updates);
 
-                            param_visitor<decltype(o)> param_visitor(o);
-                            for (const auto& element : it->second) {
-                                boost::apply_visitor(param_visitor, element);
-                            }
-
-                            o << ::osc::EndMessage;
-
-                            ++it;
-                        }
-
-                        o << ::osc::EndBundle;
-
-                        boost::system::error_code ec;
-                        for (const auto& endpoint : endpoints) {
-                            socket_.send_to(boost::asio::buffer(o.Data(), o.Size()), endpoint, 0, ec);
-                        }
+                    for (auto& p : subscribers) {
+                        publish(p.first, *p.second);
                     }
                 }
             } catch (...) {
@@ -158,12 +206,108 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         thread_.join();
     }
 
-    // TODO (refactor) This is wierd...
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+    void merge(std::vector<update>& updates)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        for (auto& u : updates) {
+            for (const auto& p : u.state) {
+                auto& v  = values_[&p.first];
+                v.values = p.second;
+                v.time   = u.time;
+            }
+            time_tag_ = u.time_tag;
+        }
+
+        for (auto it = values_.begin(); it != values_.end();) {
+            if (now - it->second.time > expiry_) {
+                it = values_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void publish(const udp::endpoint& endpoint, subscriber& sub)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now < sub.next_send) {
+            return;
+        }
+        if (sub.rate > 0.0) {
+            sub.next_send = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                      std::chrono::duration<double>(1.0 / sub.rate));
+        }
+
+        auto refresh = now >= sub.next_refresh;
+        if (refresh && refresh_interval_.count() > 0) {
+            sub.next_refresh = now + refresh_interval_;
+        }
+
+        // Forget paths that are gone, so that they are sent again should they come back.
+        for (auto it = sub.sent.begin(); it != sub.sent.end();) {
+            if (values_.find(it->first) == values_.end()) {
+                it = sub.sent.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        ::osc::OutboundPacketStream o(buffer_.data(), static_cast<unsigned long>(buffer_.size()));
+
+        auto flush = [&] {
+            if (o.IsBundleInProgress()) {
+                o << ::osc::EndBundle;
+
+                boost::system::error_code ec;
+                socket_.send_to(boost::asio::buffer(o.Data(), o.Size()), endpoint, 0, ec);
+                o.Clear();
+            }
+        };
+
+        for (auto& p : values_) {
+            auto& sent = sub.sent[p.first];
+            if (!refresh && sent == p.second.values) {
+                continue;
+            }
+            sent = p.second.values;
+
+            // Every bundle element is prefixed by its size.
+            auto size = 4 + message_size(*p.first, p.second.values);
+            if (o.IsBundleInProgress() && o.Size() + size + 4 > mtu_) {
+                flush();
+            }
+            if (!o.IsBundleInProgress()) {
+                o << ::osc::BeginBundle(time_tag_);
+            }
+
+            o << ::osc::BeginMessage(p.first->c_str());
+
+            param_visitor<decltype(o)> param_visitor(o);
+            for (const auto& element : p.second.values) {
+                boost::apply_visitor(param_visitor, element);
+            }
+
+            o << ::osc::EndMessage;
+        }
+
+        flush();
+    }
+
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint, double rate)
     {
         std::lock_guard<std::mutex> lock(mutex_);
 
-        ++reference_counts_by_endpoint_[endpoint];
+        auto& sub = subscribers_[endpoint];
+        if (!sub) {
+            sub = std::make_shared<subscriber>();
+        }
+        sub->reference_count += 1;
+
+        // The most demanding subscription of an endpoint decides its rate.
+        sub->rate = sub->reference_count == 1 || rate <= 0.0 || sub->rate <= 0.0 ? rate : std::max(sub->rate, rate);
+
+        subscriber_count_ = static_cast<int>(subscribers_.size());
 
         std::weak_ptr<impl> weak_self = shared_from_this();
 
@@ -177,22 +321,25 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
 
             std::lock_guard<std::mutex> lock(self.mutex_);
 
-            int reference_count_after = --self.reference_counts_by_endpoint_[endpoint];
-
-            if (reference_count_after == 0) {
-                self.reference_counts_by_endpoint_.erase(endpoint);
+            auto it = self.subscribers_.find(endpoint);
+            if (it != self.subscribers_.end() && --it->second->reference_count == 0) {
+                self.subscribers_.erase(it);
             }
+            self.subscriber_count_ = static_cast<int>(self.subscribers_.size());
         });
     }
 
-    void send(const core::monitor::state& state)
+    void send(core::monitor::state state)
     {
+        update u{std::move(state), std::chrono::steady_clock::now(), ntp_time(std::chrono::system_clock::now())};
         {
             std::lock_guard<std::mutex> lock(mutex_);
 
-            // TODO: time_++ is a hack. Use proper channel time.
-            bundle_time_ = time_++;
-            bundle_      = state;
+            // Should the sending thread fall behind, the oldest updates are merged away first anyway.
+            if (updates_.size() > 64) {
+                updates_.erase(updates_.begin());
+            }
+            updates_.push_back(std::move(u));
         }
         cond_.notify_all();
     }
@@ -216,11 +363,12 @@ client& client::operator=(client&& other)
 
 client::~client() {}
 
-std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint, double rate)
 {
-    return impl_->get_subscription_token(endpoint);
+    return impl_->get_subscription_token(endpoint, rate);
 }
 
-void client::send(core::monitor::state state) { impl_->send(state); }
+bool client::has_subscribers() const { return impl_->subscriber_count_ > 0; }
+void client::send(core::monitor::state state) { impl_->send(std::move(state)); }
 
 }}} // namespace caspar::protocol::osc
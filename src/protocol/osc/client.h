@@ -45,16 +45,28 @@ class client
      * the token is dropped unless another token to the same endpoint has
      * previously been checked out.
      *
+     * Only messages that changed since they were last sent to the endpoint are
+     * sent, apart from a periodic refresh of everything.
+     *
      * @param endpoint The UDP endpoint to send OSC messages to.
+     * @param rate     The maximum number of bundles per second, 0 to send on
+     *                 every update. The highest rate of all tokens to the same
+     *                 endpoint applies.
      *
      * @return The token. It is ok for the token to outlive the client
      */
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint);
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint, double rate = 0.0);
 
     ~client();
 
     client& operator=(client&&);
 
+    /**
+     * Whether any endpoint is subscribed, so that callers can skip building
+     * states that would not be sent anywhere.
+     */
+    bool has_subscribers() const;
+
     void send(core::monitor::state state);
 
   private:
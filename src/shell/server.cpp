@@ -37,6 +37,7 @@
 #include <core/producer/cg_proxy.h>
 #include <core/producer/color/color_producer.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/media_info/media_scanner.h>
 #include <core/video_channel.h>
 #include <core/video_format.h>
 
@@ -108,6 +109,7 @@ struct server::impl
     spl::shared_ptr<core::cg_producer_registry>        cg_registry_;
     spl::shared_ptr<core::frame_producer_registry>     producer_registry_;
     spl::shared_ptr<core::frame_consumer_registry>     consumer_registry_;
+    spl::shared_ptr<core::media_scanner>               media_scanner_;
     std::function<void(bool)>                          shutdown_server_now_;
 
     impl(const impl&) = delete;
@@ -123,12 +125,15 @@ struct server::impl
 
         auto ogl_device    = accelerator_.get_device();
         amcp_command_repo_ = spl::make_shared<amcp::amcp_command_repository>(
-            cg_registry_, producer_registry_, consumer_registry_, ogl_device, shutdown_server_now_);
+            cg_registry_, producer_registry_, consumer_registry_, media_scanner_, ogl_device, shutdown_server_now_);
 
-        module_dependencies dependencies(cg_registry_, producer_registry_, consumer_registry_, amcp_command_repo_);
+        module_dependencies dependencies(
+            cg_registry_, producer_registry_, consumer_registry_, media_scanner_, amcp_command_repo_);
 
         initialize_modules(dependencies);
         core::init_cg_proxy_as_producer(dependencies);
+
+        media_scanner_->start();
     }
 
     void start()
@@ -151,6 +156,7 @@ struct server::impl
         amcp_command_repo_.reset();
         primary_amcp_server_.reset();
         async_servers_.clear();
+        stop_producer_construction();
         destroy_producers_synchronously();
         destroy_consumers_synchronously();
         channels_.clear();
@@ -183,13 +189,14 @@ struct server::impl
                 spl::make_shared<video_channel>(channel_id,
                                                 format_desc,
                                                 accelerator_.create_image_mixer(channel_id),
-                                                [channel_id, weak_client](core::monitor::state channel_state) {
-                                                    monitor::state state;
-                                                    state[""]["channel"][channel_id] = channel_state;
-                                                    auto client                      = weak_client.lock();
-                                                    if (client) {
-                                                        client->send(std::move(state));
+                                                [channel_id, weak_client](const auto& channel_state) {
+                                                    auto client = weak_client.lock();
+                                                    if (!client || !client->has_subscribers()) {
+                                                        return;
                                                     }
+                                                    monitor::state state;
+                                                    state[""]["channel"][channel_id] = channel_state();
+                                                    client->send(std::move(state));
                                                 });
 
             channels_.push_back(channel);
@@ -205,9 +212,11 @@ struct server::impl
                     auto name = xml_consumer.first;
 
                     try {
-                        if (name != L"<xmlcomment>")
+                        if (name != L"<xmlcomment>") {
+                            auto consumer = consumer_registry_->create_consumer(name, xml_consumer.second, channels_);
                             channel->output().add(
-                                consumer_registry_->create_consumer(name, xml_consumer.second, channels_));
+                                consumer->index(), consumer, core::get_queue_options(xml_consumer.second));
+                        }
                     } catch (...) {
                         CASPAR_LOG_CURRENT_EXCEPTION();
                     }
@@ -223,6 +232,7 @@ struct server::impl
 
         auto default_port                 = pt.get<unsigned short>(L"configuration.osc.default-port", 6250);
         auto disable_send_to_amcp_clients = pt.get(L"configuration.osc.disable-send-to-amcp-clients", false);
+        auto default_rate                 = pt.get(L"configuration.osc.default-rate", 0.0);
         auto predefined_clients           = pt.get_child_optional(L"configuration.osc.predefined-clients");
 
         if (predefined_clients) {
@@ -232,12 +242,13 @@ struct server::impl
 
                 const auto address = ptree_get<std::wstring>(predefined_client.second, L"address");
                 const auto port    = ptree_get<unsigned short>(predefined_client.second, L"port");
+                const auto rate    = predefined_client.second.get(L"rate", default_rate);
 
                 boost::system::error_code ec;
                 auto                      ipaddr = address_v4::from_string(u8(address), ec);
                 if (!ec)
                     predefined_osc_subscriptions_.push_back(
-                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port)));
+                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port), rate));
                 else
                     CASPAR_LOG(warning) << "Invalid OSC client. Must be valid ipv4 address: " << address;
             }
@@ -250,7 +261,8 @@ struct server::impl
 
                     return std::make_pair(std::wstring(L"osc_subscribe"),
                                           osc_client_->get_subscription_token(
-                                              udp::endpoint(address_v4::from_string(ipv4_address), default_port)));
+                                              udp::endpoint(address_v4::from_string(ipv4_address), default_port),
+                                              default_rate));
                 });
     }
 